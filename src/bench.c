@@ -0,0 +1,362 @@
+#define _GNU_SOURCE // nftw
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <ftw.h>
+
+#include "sim.h"
+#include "display.h"
+
+#include "config.h"
+
+// microbenchmarks of each part of the simulation and display against chain length, and how far each integrator lets
+// the total energy wander from its starting value against the work it does
+// prints a table, or JSON with -J, to compare between versions
+
+#define BENCH_TIME 600         // default simulated seconds per energy drift run
+#define SAMPLES 101            // timed samples per benchmark, for the median and 99th percentile
+#define INIT_SAMPLES 5         // timed samples of sim_init, which are too slow to take as many of
+#define SAMPLE_NS 200000       // each sample repeats the operation for at least this long
+#define MAX_SYMBOLIC_COUNT 3   // the derivation grows quickly with chain length
+#define MAX_NUMERIC_COUNT 1024 // chain lengths double from 2 up to this
+
+typedef long long nsec_t;
+
+static nsec_t get_time(void) {
+	struct timespec tp;
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (nsec_t) tp.tv_sec * 1000000000 + tp.tv_nsec;
+}
+
+static bool json = false, first_result = true;
+
+struct stats {
+	double median, p99; // ns per operation
+};
+
+static int compare_double(const void *a, const void *b) {
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static void summarise(double *sample, unsigned samples, struct stats *stats) {
+	qsort(sample, samples, sizeof(*sample), compare_double);
+	stats->median = sample[samples / 2];
+	stats->p99 = sample[samples * 99 / 100];
+}
+
+// times op, repeated enough for the clock's resolution not to matter
+static bool measure(bool op(void *arg), void *arg, struct stats *stats) {
+	unsigned iterations = 1;
+	for (;;) {
+		nsec_t start = get_time();
+		for (unsigned i = 0; i < iterations; ++i)
+			if (!op(arg)) return false;
+		if (get_time() - start >= SAMPLE_NS || iterations >= 1 << 24) break;
+		iterations *= 2;
+	}
+
+	double sample[SAMPLES];
+	for (unsigned s = 0; s < SAMPLES; ++s) {
+		nsec_t start = get_time();
+		for (unsigned i = 0; i < iterations; ++i)
+			if (!op(arg)) return false;
+		sample[s] = (get_time() - start) / (double) iterations;
+	}
+	summarise(sample, SAMPLES, stats);
+	return true;
+}
+
+// evaluations is per operation, 0 if it doesn't apply
+static void report(const char *name, const char *variant, unsigned count, struct stats stats, double evaluations) {
+	if (json) {
+		printf("%s\n    {\"name\": \"%s\", \"variant\": \"%s\", \"count\": %u, \"median_ns\": %.1f, \"p99_ns\": %.1f",
+		       first_result ? "" : ",", name, variant, count, stats.median, stats.p99);
+		if (evaluations) printf(", \"evaluations_per_second\": %.1f", evaluations * 1e9 / stats.median);
+		printf("}");
+	} else {
+		printf("%-14s %-18s %6u %14.1f %14.1f", name, variant, count, stats.median, stats.p99);
+		if (evaluations) printf(" %14.4g", evaluations * 1e9 / stats.median);
+		printf("\n");
+	}
+	first_result = false;
+}
+
+static struct pendulum *make_chain(unsigned count) {
+	struct pendulum *chain = calloc(count, sizeof(*chain));
+	if (!chain) return NULL;
+	for (unsigned i = 0; i < count; ++i)
+		chain[i] = (struct pendulum) {.mass = 1.0 / count, .length = 2.0 / count, .angle = M_PI / 2 + 0.1 * i};
+	return chain;
+}
+
+static bool init_system(struct pendulum_system *system, struct pendulum *chain, unsigned count,
+                        enum sim_engine engine, enum sim_integrator integrator) {
+	*system = (struct pendulum_system) {.engine = engine, .integrator = integrator, .gravity = 9.81, .count = count, .chain = chain};
+	return sim_init(system);
+}
+
+static const char *engine_name(const struct pendulum_system *system) {
+	if (system->engine == SIM_ENGINE_NUMERIC) return "numeric";
+	return system->kernel ? "kernel" : "symbolic";
+}
+
+static unsigned long steps_taken;
+
+static bool op_step(void *arg) {
+	++steps_taken;
+	return sim_step(arg, 1, 1.0 / (MAX_FPS));
+}
+
+static bool op_energy(void *arg) {
+	double ke, gpe;
+	return sim_energy(arg, &ke, &gpe);
+}
+
+static bool op_render(void *arg) {
+	struct pendulum_system *system = arg;
+	for (unsigned i = 0; i < system->count; ++i) system->angle[i] += 0.01 * (i + 1); // something different each frame
+	return display_render(system, " Simulation time:        123 ns\n");
+}
+
+// the cache the benchmark derives into, removed at exit along with everything in it
+static char cache_root[] = "/tmp/dpend-bench.XXXXXX", cache_path[sizeof(cache_root) + 8];
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) { return remove(path); }
+
+static bool remove_tree(const char *path) { return !nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS) || errno == ENOENT; }
+
+static void remove_cache(void) { remove_tree(cache_root); }
+
+// times sim_init from an empty cache each sample, or from the cache left by the previous sample
+static bool time_init(struct pendulum *chain, unsigned count, bool cached, struct stats *stats, bool *kernel) {
+	double sample[INIT_SAMPLES];
+	for (unsigned s = 0; s < INIT_SAMPLES; ++s) {
+		if (!cached && !remove_tree(cache_path)) return false;
+		struct pendulum_system system;
+		nsec_t start = get_time();
+		if (!init_system(&system, chain, count, SIM_ENGINE_SYMBOLIC, SIM_INTEGRATOR_RK4)) return false;
+		sample[s] = get_time() - start;
+		*kernel = system.kernel;
+		sim_free(&system);
+		sim_state_free(&system);
+	}
+	summarise(sample, INIT_SAMPLES, stats);
+	return true;
+}
+
+static bool bench_init(void) {
+	// derive into a cache of our own, so the derivation can be timed cold
+	if (!mkdtemp(cache_root)) return false;
+	atexit(remove_cache);
+	snprintf(cache_path, sizeof(cache_path), "%s/dpend", cache_root);
+	if (setenv("XDG_CACHE_HOME", cache_root, 1)) return false;
+
+	bool ok = true;
+	for (unsigned count = 1; ok && count <= MAX_SYMBOLIC_COUNT; ++count) {
+		struct pendulum *chain = make_chain(count);
+		if (!chain) return false;
+		for (unsigned cached = 0; ok && cached < 2; ++cached) {
+			struct stats stats;
+			bool kernel;
+			if (!(ok = time_init(chain, count, cached, &stats, &kernel))) break;
+			// the generated kernel neither derives nor uses the cache
+			if (kernel) {
+				report("sim_init", "kernel", count, stats, 0);
+				break;
+			}
+			report("sim_init", cached ? "symbolic/cached" : "symbolic/derived", count, stats, 0);
+		}
+		free(chain);
+	}
+	return ok;
+}
+
+static bool bench_system(enum sim_engine engine, unsigned count) {
+	static const struct {
+		enum sim_integrator integrator;
+		const char *name;
+	} integrators[] = {
+	        {SIM_INTEGRATOR_RK4, "rk4"},
+	        {SIM_INTEGRATOR_DOPRI5, "dopri5"},
+	        {SIM_INTEGRATOR_SYMPLECTIC, "symplectic"},
+	        {SIM_INTEGRATOR_ROSENBROCK, "rosenbrock"},
+	};
+
+	struct pendulum *chain = make_chain(count);
+	if (!chain) return false;
+	bool ret = false;
+	for (unsigned i = 0; i < sizeof(integrators) / sizeof(*integrators); ++i) {
+		if (engine == SIM_ENGINE_NUMERIC && (integrators[i].integrator == SIM_INTEGRATOR_SYMPLECTIC ||
+		                                     integrators[i].integrator == SIM_INTEGRATOR_ROSENBROCK))
+			continue;
+
+		struct pendulum_system system;
+		if (!init_system(&system, chain, count, engine, integrators[i].integrator)) goto fail;
+
+		char variant[32];
+		snprintf(variant, sizeof(variant), "%s/%s", engine_name(&system), integrators[i].name);
+		struct stats stats;
+		steps_taken = 0;
+		bool ok = measure(op_step, &system, &stats);
+		// the symplectic integrator evaluates the generalised forces in place of the equations of motion
+		unsigned long evaluations = system.evaluations + system.force_evaluations;
+		if (ok) report("sim_step", variant, count, stats, evaluations / (double) steps_taken);
+
+		if (ok && integrators[i].integrator == SIM_INTEGRATOR_RK4) {
+			ok = measure(op_energy, &system, &stats);
+			if (ok) report("sim_energy", engine_name(&system), count, stats, 0);
+		}
+		sim_free(&system);
+		sim_state_free(&system);
+		if (!ok) goto fail;
+	}
+	ret = true;
+fail:
+	free(chain);
+	return ret;
+}
+
+static bool bench_render(void) {
+	static const struct {
+		size_t columns, rows;
+	} sizes[] = {{80, 24}, {160, 48}, {320, 96}};
+
+	int fd = open("/dev/null", O_WRONLY);
+	if (fd < 0) return false;
+	struct pendulum *chain = make_chain(2);
+	if (!chain) {
+		close(fd);
+		return false;
+	}
+	struct pendulum_system system = {.count = 2, .chain = chain};
+	if (!sim_state_alloc(&system)) {
+		free(chain);
+		close(fd);
+		return false;
+	}
+
+	static const char *mode_names[] = {[DISPLAY_QUADRANTS] = "", [DISPLAY_BRAILLE] = " braille"};
+
+	bool ok = true;
+	for (enum display_mode mode = DISPLAY_QUADRANTS; mode <= DISPLAY_BRAILLE; ++mode)
+		for (unsigned i = 0; ok && i < sizeof(sizes) / sizeof(*sizes); ++i) {
+			display_set_output(fd, sizes[i].columns, sizes[i].rows);
+			display_set_mode(mode);
+			char variant[32];
+			snprintf(variant, sizeof(variant), "%zux%zu%s", sizes[i].columns, sizes[i].rows, mode_names[mode]);
+			struct stats stats;
+			ok = measure(op_render, &system, &stats);
+			if (ok) report("display_render", variant, system.count, stats, 0);
+			display_disable(true); // frees the screens
+		}
+	display_set_mode(DISPLAY_QUADRANTS);
+
+	sim_state_free(&system);
+	free(chain);
+	close(fd);
+	return ok;
+}
+
+static double total_energy(struct pendulum_system *system) {
+	double ke, gpe;
+	if (!sim_energy(system, &ke, &gpe)) return NAN;
+	return ke + gpe;
+}
+
+// starts from the configured chain again each time
+static bool drift(struct pendulum_system *system, enum sim_integrator integrator, const char *name, double dt, double time, bool first) {
+	for (unsigned i = 0; i < system->count; ++i) {
+		system->angle[i] = system->chain[i].angle;
+		system->angvel[i] = system->chain[i].angvel;
+	}
+	system->integrator = integrator;
+	system->evaluations = system->mass_evaluations = system->force_evaluations = 0;
+
+	double start_energy = total_energy(system), max_error = 0;
+	unsigned long steps = time / dt;
+	for (unsigned long i = 0; i < steps; ++i) {
+		if (!sim_step(system, 1, dt)) return false;
+		max_error = fmax(max_error, fabs(total_energy(system) - start_energy));
+	}
+	double final_error = total_energy(system) - start_energy;
+
+	if (json)
+		printf("%s\n    {\"integrator\": \"%s\", \"step\": %g, \"evaluations\": %lu, \"mass_evaluations\": %lu, "
+		       "\"force_evaluations\": %lu, \"max_error\": %g, \"final_error\": %g}",
+		       first ? "" : ",", name, dt, system->evaluations, system->mass_evaluations, system->force_evaluations, max_error,
+		       final_error);
+	else
+		printf("%-14s %10.6f %12lu %12lu %12lu %12.3e %12.3e\n", name, dt, system->evaluations, system->mass_evaluations,
+		       system->force_evaluations, max_error, final_error);
+	return true;
+}
+
+// the configured system over a long run at doubling step sizes
+static bool bench_drift(double time) {
+	struct pendulum_system system = {0};
+	CONFIGURE(system);
+
+	// derive everything the symplectic integrator needs, which RK4 can run from too
+	system.integrator = SIM_INTEGRATOR_SYMPLECTIC;
+	if (!sim_init(&system)) return false;
+
+	if (!json) printf("\n%.0f simulated seconds of the configured chain, starting with %.6f J\n"
+	                  "%-14s %10s %12s %12s %12s %12s %12s\n",
+	                  time, total_energy(&system), "integrator", "step (s)", "evaluations", "mass evals", "force evals",
+	                  "max |dE| (J)", "final dE (J)");
+	bool ok = true, first = true;
+	for (double dt = 1.0 / (MAX_FPS); ok && dt < 0.1; dt *= 2, first = false) {
+		ok = drift(&system, SIM_INTEGRATOR_RK4, "rk4", dt, time, first) &&
+		     drift(&system, SIM_INTEGRATOR_SYMPLECTIC, "symplectic", dt, time, false);
+	}
+
+	sim_free(&system);
+	sim_state_free(&system);
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	double time = BENCH_TIME;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:Jh")) != -1) {
+		switch (opt) {
+			case 't':
+				if ((time = atof(optarg)) > 0) break;
+				// fallthrough
+			default:
+				fprintf(stderr, "usage: %s [-t simulated seconds (default %d)] [-J]\n"
+				                "  -t  length of the energy drift runs\n"
+				                "  -J  print JSON instead of tables\n",
+				        argv[0], BENCH_TIME);
+				return 2;
+			case 'J':
+				json = true;
+				break;
+		}
+	}
+
+	if (json) printf("{\n  \"results\": [");
+	else printf("%-14s %-18s %6s %14s %14s %14s\n", "benchmark", "variant", "count", "median (ns)", "p99 (ns)", "evaluations/s");
+
+	bool ok = bench_init();
+	for (unsigned count = 1; ok && count <= MAX_SYMBOLIC_COUNT; ++count) ok = bench_system(SIM_ENGINE_SYMBOLIC, count);
+	for (unsigned count = 2; ok && count <= MAX_NUMERIC_COUNT; count *= 2) ok = bench_system(SIM_ENGINE_NUMERIC, count);
+	if (ok) ok = bench_render();
+
+	if (json) printf("\n  ],\n  \"drift\": [");
+	if (ok) ok = bench_drift(time);
+	if (json) printf("\n  ]\n}\n");
+
+	if (!ok) {
+		fprintf(stderr, "Benchmark failed\n");
+		return 1;
+	}
+	return 0;
+}
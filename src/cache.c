@@ -0,0 +1,165 @@
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char magic[8] = "DPENDEOM";
+
+struct cache_header {
+	char magic[8];
+	uint64_t version;
+	uint32_t count, exprs;
+};
+
+#define MAX_EXPR_SIZE (1 << 30)
+
+// FNV-1a
+static uint64_t hash_str(uint64_t hash, const char *str) {
+	for (; *str; ++str) hash = (hash ^ (unsigned char) *str) * 0x100000001b3;
+	return hash;
+}
+
+static uint64_t cache_version(const char *version) {
+	uint64_t hash = 0xcbf29ce484222325;
+	hash = hash_str(hash, version);
+	hash = hash_str(hash, "\n");
+	hash = hash_str(hash, symengine_version()); // the serialisation format may change between versions
+	return hash;
+}
+
+static unsigned cache_exprs(struct pendulum_system *system) { return system->count + 2; }
+
+static basic_struct *cache_expr(struct pendulum_system *system, unsigned i) {
+	if (i == 0) return system->ke;
+	if (i == 1) return system->gpe;
+	return system->symbols[i - 2].solution_angacc;
+}
+
+static bool cache_dir(char *path, size_t size, bool create) {
+	const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+	int printf_res;
+	if (xdg && *xdg) printf_res = snprintf(path, size, "%s/dpend", xdg);
+	else if (home && *home) printf_res = snprintf(path, size, "%s/.cache/dpend", home);
+	else return false;
+	if (printf_res < 0 || printf_res >= size) return false;
+	if (!create) return true;
+
+	// create each missing directory in the path
+	for (char *c = path + 1;; ++c) {
+		if (*c != '/' && *c != '\0') continue;
+		char end = *c;
+		*c = '\0';
+		bool ok = !mkdir(path, 0755) || errno == EEXIST;
+		*c = end;
+		if (!ok) return false;
+		if (!end) return true;
+	}
+}
+
+static bool cache_path(char *path, size_t size, struct pendulum_system *system, bool create) {
+	if (!cache_dir(path, size, create)) return false;
+	size_t len = strlen(path);
+	int printf_res = snprintf(path + len, size - len, "/eom-%u.bin", system->count);
+	return printf_res >= 0 && printf_res < size - len;
+}
+
+bool cache_load(struct pendulum_system *system, const char *version) {
+	char path[PATH_MAX];
+	if (!cache_path(path, sizeof(path), system, false)) return false;
+
+	FILE *file = fopen(path, "rb");
+	if (!file) return false;
+
+	bool ret = false;
+	char *buf = NULL;
+	size_t buf_size = 0;
+
+	// load into temporaries and only assign once every expression has loaded, so a bad file never leaves the system half
+	// loaded for the derivation that follows
+	unsigned exprs = cache_exprs(system);
+	basic_struct **loaded = calloc(exprs, sizeof(*loaded));
+	if (!loaded) goto fail;
+
+	struct cache_header header;
+	if (fread(&header, sizeof(header), 1, file) != 1) goto fail;
+	if (memcmp(header.magic, magic, sizeof(magic))) goto fail;
+	if (header.version != cache_version(version)) goto fail;
+	if (header.count != system->count || header.exprs != exprs) goto fail;
+
+	for (unsigned i = 0; i < exprs; ++i) {
+		uint64_t size;
+		if (fread(&size, sizeof(size), 1, file) != 1) goto fail;
+		if (size == 0 || size > MAX_EXPR_SIZE) goto fail;
+		if (size > buf_size) {
+			char *new_buf = realloc(buf, size);
+			if (!new_buf) goto fail;
+			buf = new_buf;
+			buf_size = size;
+		}
+		if (fread(buf, 1, size, file) != size) goto fail;
+		if (!(loaded[i] = basic_new_heap())) goto fail;
+		if (basic_loads(loaded[i], buf, size)) goto fail;
+	}
+
+	for (unsigned i = 0; i < exprs; ++i) {
+		if (!basic_assign(cache_expr(system, i), loaded[i])) continue;
+		// the energies are accumulated into by the derivation, so they must be zero again
+		basic_const_zero(system->ke);
+		basic_const_zero(system->gpe);
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	if (loaded)
+		for (unsigned i = 0; i < exprs; ++i)
+			if (loaded[i]) basic_free_heap(loaded[i]);
+	free(loaded);
+	free(buf);
+	fclose(file);
+	return ret;
+}
+
+bool cache_save(struct pendulum_system *system, const char *version) {
+	char path[PATH_MAX], temp_path[PATH_MAX + 16];
+	if (!cache_path(path, sizeof(path), system, true)) return false;
+
+	// write to a temporary file and rename it over the cache, so concurrently starting instances never see a partial file
+	int printf_res = snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", path);
+	if (printf_res < 0 || printf_res >= sizeof(temp_path)) return false;
+	int fd = mkstemp(temp_path);
+	if (fd < 0) return false;
+	FILE *file = fdopen(fd, "wb");
+	if (!file) {
+		close(fd);
+		unlink(temp_path);
+		return false;
+	}
+
+	bool ret = false;
+	struct cache_header header = {.version = cache_version(version), .count = system->count, .exprs = cache_exprs(system)};
+	memcpy(header.magic, magic, sizeof(magic));
+	if (fwrite(&header, sizeof(header), 1, file) != 1) goto fail;
+
+	for (unsigned i = 0; i < header.exprs; ++i) {
+		size_t size;
+		char *data = basic_dumps(cache_expr(system, i), &size);
+		if (!data) goto fail;
+		uint64_t size64 = size;
+		bool ok = fwrite(&size64, sizeof(size64), 1, file) == 1 && fwrite(data, 1, size, file) == size;
+		basic_str_free(data);
+		if (!ok) goto fail;
+	}
+
+	ret = true;
+fail:
+	if (fclose(file)) ret = false;
+	if (ret && rename(temp_path, path)) ret = false;
+	if (!ret) unlink(temp_path);
+	return ret;
+}
@@ -0,0 +1,10 @@
+#ifndef CACHE_H
+#define CACHE_H
+#include "sim.h"
+#include <stdbool.h>
+
+// persists the derived kinetic and potential energy and angular accelerations between runs
+// files live in $XDG_CACHE_HOME/dpend (or ~/.cache/dpend), keyed by chain length, and are ignored if the derivation version or SymEngine version differs
+bool cache_load(struct pendulum_system *system, const char *version);
+bool cache_save(struct pendulum_system *system, const char *version);
+#endif
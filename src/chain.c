@@ -0,0 +1,66 @@
+#define _GNU_SOURCE // sincos
+#include "chain.h"
+#include <math.h>
+
+// each pendulum is a point mass on a massless rod hanging from the end of the previous one
+// u_i = (sin θ_i, -cos θ_i) points along rod i, n_i = (cos θ_i, sin θ_i) is perpendicular to it and gravity is (0, -g)
+// the rod tensions T_i are solved for first, since they form a tridiagonal system, then the angular accelerations follow from the force on each mass
+
+#define GRAVITY (params[0])
+#define MASS(i) (params[1 + (i)])
+#define LENGTH(i) (params[1 + count + (i)])
+#define ANGLE(i) (y[(i)])
+#define ANGVEL(i) (y[count + (i)])
+
+void chain_angacc(unsigned count, const double *params, const double *y, double *angacc, double *scratch) {
+	if (count == 0) return;
+
+	double *s = scratch, *c = s + count, *upper = c + count, *tension = upper + count;
+	for (unsigned i = 0; i < count; ++i) sincos(ANGLE(i), &s[i], &c[i]);
+
+	// m_i a_i = T_{i+1} u_{i+1} - T_i u_i + m_i g, and keeping rod i the same length requires u_i · (a_i - a_{i-1}) = -l_i ω_i²
+	// which gives T_i (1/m_i + 1/m_{i-1}) - T_{i-1} (u_i · u_{i-1}) / m_{i-1} - T_{i+1} (u_i · u_{i+1}) / m_i = l_i ω_i² (+ g cos θ_0 for the first rod)
+	// eliminate the lower diagonal going down the chain (Thomas algorithm)
+	for (unsigned i = 0; i < count; ++i) {
+		double inv_mass = 1 / MASS(i), angvel = ANGVEL(i);
+		double diag = inv_mass, rhs = LENGTH(i) * angvel * angvel;
+		if (i == 0) {
+			rhs += GRAVITY * c[0];
+		} else {
+			double inv_mass_prev = 1 / MASS(i - 1),
+			       lower = -(c[i] * c[i - 1] + s[i] * s[i - 1]) * inv_mass_prev;
+			diag += inv_mass_prev - lower * upper[i - 1];
+			rhs -= lower * tension[i - 1];
+		}
+		upper[i] = i + 1 < count ? -(c[i] * c[i + 1] + s[i] * s[i + 1]) * inv_mass / diag : 0;
+		tension[i] = rhs / diag;
+	}
+
+	// back substitution
+	for (unsigned i = count - 1; i-- > 0;) tension[i] -= upper[i] * tension[i + 1];
+
+	// θ''_i = n_i · (a_i - a_{i-1}) / l_i, where n_i · u_j = sin(θ_j - θ_i)
+	for (unsigned i = 0; i < count; ++i) {
+		double acc = 0;
+		if (i + 1 < count) acc += tension[i + 1] * (s[i + 1] * c[i] - c[i + 1] * s[i]) / MASS(i);
+		if (i == 0) acc -= GRAVITY * s[0];
+		else acc += tension[i - 1] * (s[i - 1] * c[i] - c[i - 1] * s[i]) / MASS(i - 1);
+		angacc[i] = acc / LENGTH(i);
+	}
+}
+
+void chain_energy(unsigned count, const double *params, const double *y, double *ke, double *gpe) {
+	double vx = 0, vy = 0, height = 0;
+	*ke = 0, *gpe = 0;
+	for (unsigned i = 0; i < count; ++i) {
+		double angvel = ANGVEL(i), s, c;
+		sincos(ANGLE(i), &s, &c);
+
+		vx += LENGTH(i) * angvel * c;
+		vy += LENGTH(i) * angvel * s;
+		height += LENGTH(i) * (1 - c);
+
+		*ke += 0.5 * MASS(i) * (vx * vx + vy * vy);
+		*gpe += MASS(i) * GRAVITY * height;
+	}
+}
@@ -0,0 +1,12 @@
+#ifndef CHAIN_H
+#define CHAIN_H
+
+// numeric equations of motion for long chains, taking O(count) time per evaluation instead of deriving them symbolically
+
+#define CHAIN_SCRATCH(count) ((count) * 4) // doubles of scratch space needed by chain_angacc
+
+// params holds gravity, then the mass of each pendulum, then the length of each
+// y holds the angle of each pendulum, then the angular velocity of each
+void chain_angacc(unsigned count, const double *params, const double *y, double *angacc, double *scratch);
+void chain_energy(unsigned count, const double *params, const double *y, double *ke, double *gpe);
+#endif
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "sim.h"
+#include "ensemble.h"
+
+// checks that the different ways of stepping the same system agree, run after building
+// prints one line per check and exits with a non-zero status if any of them failed
+
+#define CHECK_STEPS 100    // RK4 steps per check
+#define CHECK_TIME 1.0     // simulated seconds per check
+#define ENSEMBLE_SIZE 13   // not a multiple of VM_LANES, so the padding of the last block is stepped too
+#define ENSEMBLE_TOLERANCE 1e-9 // the lanes use the sin/cos of vmath.h rather than libm, so they only agree to rounding
+#define THREAD_SPANS 2000  // calls to sim_step per system in the threaded check, so the threads overlap for a while
+
+static const char *engine_name(const struct pendulum_system *system) {
+	if (system->engine == SIM_ENGINE_NUMERIC) return "numeric";
+	return system->kernel ? "kernel" : "symbolic";
+}
+
+static bool init_system(struct pendulum_system *system, struct pendulum *chain, unsigned count, enum sim_engine engine,
+                        enum sim_integrator integrator) {
+	for (unsigned i = 0; i < count; ++i)
+		chain[i] = (struct pendulum) {.mass = 1 + 0.25 * i, .length = 1.0 / (i + 1), .angle = M_PI / 2 + 0.3 * i};
+	*system = (struct pendulum_system) {.engine = engine, .integrator = integrator, .gravity = 9.81, .count = count, .chain = chain};
+	return sim_init(system);
+}
+
+// each member gets its own gravity, last mass and first angle
+static void vary(double *gravity, double *mass, double *angle, unsigned index) {
+	*gravity += 0.01 * index;
+	*mass *= 1 + 0.05 * index;
+	*angle += 0.1 * index;
+}
+
+// sim_step_batch against sim_step on each member in turn
+static bool check_ensemble(enum sim_engine engine, unsigned count) {
+	struct pendulum *chain = calloc(count, sizeof(*chain));
+	if (!chain) return false;
+	struct pendulum_system system;
+	struct sim_ensemble ensemble = {0};
+	bool ret = false;
+	if (!init_system(&system, chain, count, engine, SIM_INTEGRATOR_RK4)) {
+		free(chain);
+		return false;
+	}
+	if (!ensemble_init(&ensemble, &system, ENSEMBLE_SIZE)) goto fail;
+
+	for (unsigned k = 0; k < ENSEMBLE_SIZE; ++k)
+		vary(ensemble_gravity(&ensemble, k), ensemble_mass(&ensemble, k, count - 1), ensemble_angle(&ensemble, k, 0), k);
+	if (!sim_step_batch(&ensemble, CHECK_STEPS, CHECK_TIME)) goto fail;
+
+	double max_error = 0;
+	for (unsigned k = 0; k < ENSEMBLE_SIZE; ++k) {
+		// the system steps in place, so start it from the chain again
+		system.gravity = 9.81;
+		for (unsigned i = 0; i < count; ++i) {
+			system.mass[i] = chain[i].mass;
+			system.angle[i] = chain[i].angle;
+			system.angvel[i] = chain[i].angvel;
+		}
+		vary(&system.gravity, &system.mass[count - 1], &system.angle[0], k);
+		if (!sim_step(&system, CHECK_STEPS, CHECK_TIME)) goto fail;
+
+		for (unsigned i = 0; i < count; ++i) {
+			max_error = fmax(max_error, fabs(*ensemble_angle(&ensemble, k, i) - system.angle[i]));
+			max_error = fmax(max_error, fabs(*ensemble_angvel(&ensemble, k, i) - system.angvel[i]));
+		}
+	}
+
+	ret = max_error <= ENSEMBLE_TOLERANCE;
+	printf("%-4s ensemble %-9s count %-4u max error %.3e\n", ret ? "ok" : "FAIL", engine_name(&system), count, max_error);
+fail:
+	ensemble_free(&ensemble);
+	sim_free(&system);
+	sim_state_free(&system);
+	free(chain);
+	return ret;
+}
+
+static const struct {
+	enum sim_engine engine;
+	enum sim_integrator integrator;
+	unsigned count;
+} thread_systems[] = {
+        {SIM_ENGINE_SYMBOLIC, SIM_INTEGRATOR_RK4, 1},
+        {SIM_ENGINE_SYMBOLIC, SIM_INTEGRATOR_RK4, 2},
+        {SIM_ENGINE_SYMBOLIC, SIM_INTEGRATOR_DOPRI5, 2},
+        {SIM_ENGINE_SYMBOLIC, SIM_INTEGRATOR_SYMPLECTIC, 2},
+        {SIM_ENGINE_SYMBOLIC, SIM_INTEGRATOR_ROSENBROCK, 3},
+        {SIM_ENGINE_NUMERIC, SIM_INTEGRATOR_RK4, 5},
+        {SIM_ENGINE_NUMERIC, SIM_INTEGRATOR_DOPRI5, 5},
+        {SIM_ENGINE_NUMERIC, SIM_INTEGRATOR_RK4, 64},
+};
+#define THREAD_SYSTEMS (sizeof(thread_systems) / sizeof(*thread_systems))
+
+struct thread_run {
+	struct pendulum_system system;
+	struct pendulum *chain;
+	pthread_t thread;
+	bool ok;
+};
+
+static void *run(void *arg) {
+	struct thread_run *run = arg;
+	run->ok = true;
+	for (unsigned span = 0; run->ok && span < THREAD_SPANS; ++span)
+		run->ok = sim_step(&run->system, CHECK_STEPS / 10, CHECK_TIME / 10);
+	return NULL;
+}
+
+// every system stepped on a thread of its own against the same systems stepped one after another, which must agree bitwise
+// since nothing is shared between systems
+static bool check_threads(void) {
+	struct thread_run serial[THREAD_SYSTEMS] = {0}, threaded[THREAD_SYSTEMS] = {0};
+	unsigned started = 0;
+	bool ret = false;
+	for (unsigned i = 0; i < THREAD_SYSTEMS; ++i) {
+		unsigned count = thread_systems[i].count;
+		struct thread_run *runs[] = {&serial[i], &threaded[i]};
+		for (unsigned j = 0; j < 2; ++j) {
+			if (!(runs[j]->chain = calloc(count, sizeof(*runs[j]->chain)))) goto fail;
+			if (!init_system(&runs[j]->system, runs[j]->chain, count, thread_systems[i].engine, thread_systems[i].integrator))
+				goto fail;
+		}
+	}
+
+	for (unsigned i = 0; i < THREAD_SYSTEMS; ++i) run(&serial[i]);
+	for (; started < THREAD_SYSTEMS; ++started)
+		if (pthread_create(&threaded[started].thread, NULL, run, &threaded[started])) goto fail;
+
+	ret = true;
+fail:
+	for (unsigned i = 0; i < started; ++i) pthread_join(threaded[i].thread, NULL);
+	unsigned mismatched = 0;
+	for (unsigned i = 0; ret && i < THREAD_SYSTEMS; ++i) {
+		if (!serial[i].ok || !threaded[i].ok) ret = false;
+		// angvel follows angle, see sim.h
+		else if (memcmp(serial[i].system.angle, threaded[i].system.angle, thread_systems[i].count * 2 * sizeof(double))) ++mismatched;
+	}
+	if (ret) {
+		ret = !mismatched;
+		printf("%-4s threads  %u systems, %u differ from serial runs\n", ret ? "ok" : "FAIL", (unsigned) THREAD_SYSTEMS, mismatched);
+	}
+	for (unsigned i = 0; i < THREAD_SYSTEMS; ++i) {
+		struct thread_run *runs[] = {&serial[i], &threaded[i]};
+		for (unsigned j = 0; j < 2; ++j) {
+			sim_free(&runs[j]->system);
+			sim_state_free(&runs[j]->system);
+			free(runs[j]->chain);
+		}
+	}
+	return ret;
+}
+
+int main(void) {
+	bool ok = true;
+	for (unsigned count = 1; count <= 3; ++count) ok &= check_ensemble(SIM_ENGINE_SYMBOLIC, count);
+	ok &= check_ensemble(SIM_ENGINE_NUMERIC, 5);
+	ok &= check_threads();
+
+	if (!ok) {
+		fprintf(stderr, "Checks failed\n");
+		return 1;
+	}
+	return 0;
+}
@@ -1,9 +1,17 @@
 #define MAX_FPS 240
+#define SIMULATION_RATE 240 // simulation ticks per second, independent of the frame rate, which the headless modes step at too
 #define SIMULATION_SPEED 1
-#define STEPS_PER_FRAME 1
-#define FRAME_SKIP true // frame skipping is non-deterministic
+#define STEPS_PER_TICK 1
+#define DOPRI_ATOL 1e-8 // error tolerances of the adaptive integrator (-i dopri5)
+#define DOPRI_RTOL 1e-8
+#define MAX_CATCH_UP 8 // most simulation ticks run back to back after falling behind, past which the simulation slows down
+#define HEADLESS_TIME 10 // default simulated seconds for sweeps (-S) and recordings (-w)
+#define PROFILE false // time each phase of a frame and show the percentiles in the overlay, see prof.h
+#define PROFILE_DUMP_INTERVAL 1 // seconds between writing the histograms to the file given with -P
 #define DEBUG false // disable tcsetattr and terminal ANSI codes when entering/exiting display mode
 #define CONFIGURE(system)                                                   \
+	system.engine = SIM_ENGINE_SYMBOLIC;                                    \
+	system.integrator = SIM_INTEGRATOR_RK4;                                 \
 	system.gravity = 9.81;                                                  \
 	system.count = 2;                                                       \
 	system.chain = (struct pendulum[]) {                                    \
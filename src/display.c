@@ -1,7 +1,11 @@
 #include "display.h"
 #include "util.h"
+#include "prof.h"
 
 #include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <limits.h>
@@ -12,7 +16,7 @@
 #include <string.h>
 #include <math.h>
 
-#define DISPLAY_FD (STDOUT_FILENO)
+#define DISPLAY_FD (display.fd)
 #define eprintf(...) \
 	if (dprintf(DISPLAY_FD, __VA_ARGS__) < 0) goto fail
 
@@ -23,31 +27,107 @@ struct display_screen {
 			size_t w, h;
 		};
 	};
+	size_t stride; // words per row
 	size_t buf_size;
-	char *buf;
+	uint64_t *buf; // one bit per pixel, each row starting on a word
 };
 
-#define INDEX(pos, screen) ((size_t) (pos.y) * (size_t) (screen.w) + (size_t) (pos.x))
-#define INDEX_CHAR(pos, screen) (INDEX(pos, screen) / CHAR_BIT)
-#define INDEX_BIT(pos, screen) (1 << (INDEX(pos, screen) % CHAR_BIT)) // returns bit mask
-#define SCREEN_BUF_SIZE(screen) (((screen.w * screen.h) + CHAR_BIT - 1) / CHAR_BIT)
+#define SCREEN_STRIDE(screen) (((screen).w + 63) / 64)
+
+#define SET_PIXEL(x, y, screen) ((screen).buf[(y) * (screen).stride + (x) / 64] |= (uint64_t) 1 << ((x) % 64))
+
+#define GLYPH_SLACK 32 // cells past the end of the glyphs, since they're found a word of pixels at a time
+
+// a frame is composed here and written with a single syscall, so the terminal never sees half of one
+struct display_output {
+	char *buf;
+	size_t size, capacity;
+};
 
-#define CELL_IN_BOUNDS(pos, screen) ((pos).x >= 0 && (pos).y >= 0 && (pos).x < (screen).w && (pos).y < (screen).h)
-#define SET_BIT(char, mask, set) ((set) ? (char) | (mask) : (char) &~(mask))
-#define GET_CELL(pos, screen) (CELL_IN_BOUNDS(pos, screen) ? ((screen.buf[INDEX_CHAR(pos, screen)] & INDEX_BIT(pos, screen)) != 0) : 0)
-#define SET_CELL(pos, set, screen)   \
-	if (CELL_IN_BOUNDS(pos, screen)) \
-	(screen.buf[INDEX_CHAR(pos, screen)] = SET_BIT(screen.buf[INDEX_CHAR(pos, screen)], INDEX_BIT(pos, screen), set))
+#define oprintf(...) \
+	if (!output_printf(__VA_ARGS__)) goto fail
 
 static struct display_data {
+	int fd;
+	struct poss fixed_size; // used instead of the terminal size if set
+	volatile sig_atomic_t resized; // the terminal size needs to be read again
+	struct display_output output;
+	enum display_mode mode;
 	struct termios old_termios;
 	struct poss term_size;
-	struct display_screen screen[2]; // double-buffered rendering
-	unsigned screen_index;
-} display;
+	struct display_screen screen;
+	// glyph index of each terminal cell on screen since the last frame, and in the frame being drawn
+	// only the cells that differ are written, so a mostly still picture costs few bytes
+	unsigned char *glyphs[2];
+	struct poss glyphs_size;
+	struct poss cursor; // where the terminal's cursor is, x is CURSOR_UNKNOWN if it can't be relied on
+} display = {.fd = STDOUT_FILENO, .resized = true};
+
+#define SCREEN (display.screen)
+#define CURSOR_UNKNOWN SIZE_MAX
+
+void display_set_output(int fd, size_t columns, size_t rows) {
+	display.fd = fd;
+	display.fixed_size = POSS(columns, rows);
+	display.resized = true;
+}
+
+void display_resize(void) { display.resized = true; }
+
+void display_set_mode(enum display_mode mode) {
+	display.mode = mode;
+	display.glyphs_size = POSS2(0); // redraw everything
+}
+
+static bool output_reserve(size_t size) {
+	struct display_output *o = &display.output;
+	if (o->size + size <= o->capacity) return true;
+	size_t capacity = o->capacity ? o->capacity : 4096;
+	while (capacity < o->size + size) capacity *= 2;
+	char *buf = realloc(o->buf, capacity);
+	if (!buf) return false;
+	o->buf = buf;
+	o->capacity = capacity;
+	return true;
+}
+
+static bool output_append(const char *str, size_t size) {
+	if (!output_reserve(size)) return false;
+	memcpy(display.output.buf + display.output.size, str, size);
+	display.output.size += size;
+	return true;
+}
+
+static bool output_printf(const char *format, ...) {
+	struct display_output *o = &display.output;
+	if (!output_reserve(1)) return false;
+	va_list args;
+	for (;;) {
+		va_start(args, format);
+		int printf_res = vsnprintf(o->buf + o->size, o->capacity - o->size, format, args);
+		va_end(args);
+		if (printf_res < 0) return false;
+		if (o->size + printf_res < o->capacity) {
+			o->size += printf_res;
+			return true;
+		}
+		if (!output_reserve(printf_res + 1)) return false;
+	}
+}
 
-#define SCREEN (display.screen[display.screen_index])
-#define SCREEN_OTHER (display.screen[display.screen_index ^ 1])
+static bool output_flush(void) {
+	struct display_output *o = &display.output;
+	for (size_t written = 0; written < o->size;) {
+		ssize_t res = write(DISPLAY_FD, o->buf + written, o->size - written);
+		if (res < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		written += res;
+	}
+	o->size = 0;
+	return true;
+}
 
 bool display_enable(bool debug) {
 	if (tcgetattr(DISPLAY_FD, &display.old_termios)) return false;
@@ -64,17 +144,22 @@ bool display_enable(bool debug) {
 		eprintf("\x1b[?25l");   // hide cursor
 	}
 
-	display.screen[0].buf = NULL;
-	display.screen[1].buf = NULL;
-	display.screen_index = 0;
+	display.screen.buf = NULL;
+	display.screen.buf_size = 0;
+	display.glyphs[0] = display.glyphs[1] = NULL;
+	display.resized = true; // the terminal may have changed while we were stopped
 	return true;
 fail:
 	return false;
 }
 
 bool display_disable(bool debug) {
-	FREE(display.screen[0].buf);
-	FREE(display.screen[1].buf);
+	FREE(display.screen.buf);
+	display.screen.buf_size = 0;
+	FREE(display.glyphs[0]);
+	FREE(display.glyphs[1]);
+	FREE(display.output.buf);
+	display.output.size = display.output.capacity = 0;
 
 	if (!debug) {
 		eprintf("\x1b[H");                                                      // move to start
@@ -89,48 +174,270 @@ fail:
 	return false;
 }
 
-bool display_render(struct pendulum_system *system, const char *info) {
-	bool res = false;
+// Liang–Barsky, clips the segment to [0, max.x] x [0, max.y], false if none of it is inside
+static bool clip_line(struct posf *from, struct posf *to, struct posf max) {
+	if (!isfinite(from->x) || !isfinite(from->y) || !isfinite(to->x) || !isfinite(to->y)) return false;
+	float dx = to->x - from->x, dy = to->y - from->y, t0 = 0, t1 = 1;
+	// the segment is inside edge i where p[i] t <= q[i]
+	float p[4] = {-dx, dx, -dy, dy}, q[4] = {from->x, max.x - from->x, from->y, max.y - from->y};
+	for (unsigned i = 0; i < 4; ++i) {
+		if (p[i] == 0) {
+			if (q[i] < 0) return false; // parallel to and outside the edge
+			continue;
+		}
+		float t = q[i] / p[i];
+		if (p[i] < 0) {
+			if (t > t1) return false;
+			if (t > t0) t0 = t; // entering
+		} else {
+			if (t < t0) return false;
+			if (t < t1) t1 = t; // leaving
+		}
+	}
+	struct posf start = *from;
+	*from = POSF(start.x + t0 * dx, start.y + t0 * dy);
+	*to = POSF(start.x + t1 * dx, start.y + t1 * dy);
+	return true;
+}
 
-	eprintf("\x1b[H"); // move to start
+// sets pixels [x0, x1] of row y a word at a time
+static void fill_span(struct display_screen *screen, size_t y, size_t x0, size_t x1) {
+	uint64_t *row = screen->buf + y * screen->stride;
+	size_t first = x0 / 64, last = x1 / 64;
+	uint64_t first_mask = ~(uint64_t) 0 << (x0 % 64), last_mask = ~(uint64_t) 0 >> (63 - x1 % 64);
+	if (first == last) {
+		row[first] |= first_mask & last_mask;
+		return;
+	}
+	row[first] |= first_mask;
+	for (size_t word = first + 1; word < last; ++word) row[word] = ~(uint64_t) 0;
+	row[last] |= last_mask;
+}
 
-	struct winsize ioctl_term_size;
-	if (ioctl(DISPLAY_FD, TIOCGWINSZ, &ioctl_term_size)) return false; // get terminal size
+// Bresenham between pixels that are on the screen
+static void draw_line(struct display_screen *screen, long x0, long y0, long x1, long y1) {
+	long dx = labs(x1 - x0), dy = labs(y1 - y0);
+	if (dx >= dy) {
+		// mostly horizontal, so fill the run of pixels on each row at once
+		if (x0 > x1) {
+			SWAP(long, x0, x1);
+			SWAP(long, y0, y1);
+		}
+		long step = y1 > y0 ? 1 : -1, error = dx / 2, run = x0, y = y0;
+		for (long x = x0; x <= x1; ++x) {
+			error -= dy;
+			if (error < 0) {
+				fill_span(screen, y, run, x);
+				y += step;
+				error += dx;
+				run = x + 1;
+			}
+		}
+		if (run <= x1) fill_span(screen, y, run, x1);
+	} else {
+		if (y0 > y1) {
+			SWAP(long, x0, x1);
+			SWAP(long, y0, y1);
+		}
+		long step = x1 > x0 ? 1 : -1, error = dy / 2, x = x0;
+		for (long y = y0; y <= y1; ++y) {
+			SET_PIXEL(x, y, *screen);
+			error -= dx;
+			if (error < 0) {
+				x += step;
+				error += dy;
+			}
+		}
+	}
+}
+
+static const struct poss block_sizes[] = {[DISPLAY_QUADRANTS] = POSS(2, 2), [DISPLAY_BRAILLE] = POSS(2, 4)}; // pixels per terminal cell
 
-	struct posf stretch = POSF(2, 1);
+static const char *quadrant_chars[] = {" ", "▘", "▝", "▀", "▖", "▌", "▞", "▛", "▗", "▚", "▐", "▜", "▄", "▙", "▟", "█"};
 
-	const static struct poss block_size = POSS(2, 2); // adjust code for producing block character if changing this
+// bits of the glyph index set by the left and right pixels of each row of a cell
+// quadrants index quadrant_chars, braille dots are numbered down the left column then the right, with the bottom row added as 7 and 8
+static const unsigned char glyph_bits[][4][2] = {
+        [DISPLAY_QUADRANTS] = {{0x01, 0x02}, {0x04, 0x08}},
+        [DISPLAY_BRAILLE] = {{0x01, 0x08}, {0x02, 0x10}, {0x04, 0x20}, {0x40, 0x80}},
+};
+
+// for each row of a cell, the glyph bits of 4 neighbouring cells (one per byte) from the 8 pixels of that row they cover
+static uint32_t glyph_lut[4][256];
+static enum display_mode glyph_lut_mode = -1;
+
+static void build_glyph_lut(enum display_mode mode) {
+	for (unsigned row = 0; row < 4; ++row)
+		for (unsigned byte = 0; byte < 256; ++byte) {
+			uint32_t glyphs = 0;
+			for (unsigned cell = 0; cell < 4; ++cell) {
+				unsigned char bits = 0;
+				if (byte >> (cell * 2) & 1) bits |= glyph_bits[mode][row][0];
+				if (byte >> (cell * 2 + 1) & 1) bits |= glyph_bits[mode][row][1];
+				glyphs |= (uint32_t) bits << (cell * 8);
+			}
+			glyph_lut[row][byte] = glyphs;
+		}
+	glyph_lut_mode = mode;
+}
 
-	display.term_size = POSS(ioctl_term_size.ws_col, ioctl_term_size.ws_row);
+// blanks are written as spaces, every other glyph is 3 bytes of UTF-8 in both modes
+static size_t glyph_size(unsigned char glyph) { return glyph ? 3 : 1; }
+
+static bool output_glyph(unsigned char glyph) {
+	if (display.mode == DISPLAY_QUADRANTS || !glyph) return output_append(quadrant_chars[glyph], glyph_size(glyph));
+	unsigned char utf8[3] = {0xe2, 0xa0 | glyph >> 6, 0x80 | (glyph & 0x3f)}; // U+2800 + glyph
+	return output_append((const char *) utf8, sizeof(utf8));
+}
+
+#define MAX_OVERWRITE 8 // longest gap of unchanged cells that is rewritten instead of moving over it
+
+static size_t digits(size_t n) {
+	size_t d = 1;
+	for (; n >= 10; n /= 10) ++d;
+	return d;
+}
+
+// bytes of "\x1b[<n><final>", where n is left out if it is 1
+static size_t csi_size(size_t n) { return n == 1 ? 3 : 3 + digits(n); }
+
+static bool output_csi(size_t n, char final) {
+	return n == 1 ? output_printf("\x1b[%c", final) : output_printf("\x1b[%zu%c", n, final);
+}
+
+enum horizontal_move {
+	MOVE_NONE,
+	MOVE_FORWARD,   // CUF
+	MOVE_BACK,      // CUB
+	MOVE_BACKSPACE, // \b per column
+	MOVE_OVERWRITE, // write the glyphs already there again
+};
+
+// cheapest way along a row from one column to another, where row holds the glyphs that are on screen
+static size_t horizontal_size(size_t from, size_t to, const unsigned char *row, bool overwrite, enum horizontal_move *move) {
+	if (from == to) {
+		*move = MOVE_NONE;
+		return 0;
+	}
+	if (to < from) {
+		size_t back = csi_size(from - to), backspace = from - to;
+		*move = backspace < back ? MOVE_BACKSPACE : MOVE_BACK;
+		return backspace < back ? backspace : back;
+	}
+	size_t forward = csi_size(to - from);
+	*move = MOVE_FORWARD;
+	if (overwrite && to - from <= MAX_OVERWRITE) {
+		size_t size = 0;
+		for (size_t x = from; x < to; ++x) size += glyph_size(row[x]);
+		if (size < forward) {
+			*move = MOVE_OVERWRITE;
+			return size;
+		}
+	}
+	return forward;
+}
+
+static bool output_horizontal(size_t from, size_t to, const unsigned char *row, enum horizontal_move move) {
+	switch (move) {
+		case MOVE_NONE: return true;
+		case MOVE_FORWARD: return output_csi(to - from, 'C');
+		case MOVE_BACK: return output_csi(from - to, 'D');
+		case MOVE_BACKSPACE:
+			for (size_t x = to; x < from; ++x)
+				if (!output_append("\b", 1)) return false;
+			return true;
+		case MOVE_OVERWRITE:
+			for (size_t x = from; x < to; ++x)
+				if (!output_glyph(row[x])) return false;
+			return true;
+	}
+	return false;
+}
+
+// moves the cursor to the given cell with as few bytes as possible, comparing an absolute move against relative moves
+// from the current position or from the start of the line
+// row holds the glyphs on screen in the destination row, which may be written over if overwrite is set
+static bool move_cursor(struct poss to, const unsigned char *row, bool overwrite) {
+	struct poss from = display.cursor;
+	display.cursor = to;
+
+	enum { ABSOLUTE, RELATIVE, RETURN } plan = ABSOLUTE;
+	size_t best = to.x == 0 ? 3 + digits(to.y + 1) : 4 + digits(to.y + 1) + digits(to.x + 1);
+	enum horizontal_move relative_move, return_move;
+	if (from.x != CURSOR_UNKNOWN) {
+		// CUD/CUU keep the column, linefeeds only do that in raw mode so they are only used after a carriage return
+		size_t vertical = to.y > from.y ? csi_size(to.y - from.y) : to.y < from.y ? csi_size(from.y - to.y) : 0;
+		size_t relative = vertical + horizontal_size(from.x, to.x, row, overwrite, &relative_move);
+		if (relative < best) best = relative, plan = RELATIVE;
+
+		size_t linefeeds = to.y > from.y ? to.y - from.y : vertical;
+		size_t ret = 1 + (linefeeds < vertical ? linefeeds : vertical) + horizontal_size(0, to.x, row, overwrite, &return_move);
+		if (ret < best) best = ret, plan = RETURN;
+	}
+
+	switch (plan) {
+		case ABSOLUTE:
+			if (to.x == 0) return output_printf("\x1b[%zuH", to.y + 1);
+			return output_printf("\x1b[%zu;%zuH", to.y + 1, to.x + 1);
+		case RELATIVE:
+			if (to.y > from.y && !output_csi(to.y - from.y, 'B')) return false;
+			if (to.y < from.y && !output_csi(from.y - to.y, 'A')) return false;
+			return output_horizontal(from.x, to.x, row, relative_move);
+		case RETURN:
+			if (!output_append("\r", 1)) return false;
+			if (to.y > from.y && to.y - from.y < csi_size(to.y - from.y)) {
+				for (size_t y = from.y; y < to.y; ++y)
+					if (!output_append("\n", 1)) return false;
+			} else if (to.y > from.y && !output_csi(to.y - from.y, 'B')) return false;
+			if (to.y < from.y && !output_csi(from.y - to.y, 'A')) return false;
+			return output_horizontal(0, to.x, row, return_move);
+	}
+	return false;
+}
+
+bool display_render(struct pendulum_system *system, const char *info) {
+	bool res = false;
+
+	display.output.size = 0;
+	oprintf("\x1b[H"); // move to start
+
+	PROF_BEGIN(raster);
+	if (display.resized) {
+		// only read the terminal size again after SIGWINCH, see display_resize
+		display.resized = false;
+		struct winsize ioctl_term_size = {.ws_col = display.fixed_size.x, .ws_row = display.fixed_size.y};
+		if (!ioctl_term_size.ws_col && ioctl(DISPLAY_FD, TIOCGWINSZ, &ioctl_term_size)) return false; // get terminal size
+		display.term_size = POSS(ioctl_term_size.ws_col, ioctl_term_size.ws_row);
+	}
+
+	struct poss block_size = block_sizes[display.mode];
+	struct posf stretch = POSF(2.0f * block_size.x / block_size.y, 1); // terminal cells are about twice as tall as they are wide
 
 	// initialise new screen
-	display.screen_index ^= 1;
 	SCREEN.size = poss_mul(display.term_size, block_size);
-	size_t buf_size = SCREEN_BUF_SIZE(SCREEN);
-	bool needs_clear = true;
-	// see https://stackoverflow.com/a/39562813
-	if (SCREEN.buf == NULL || buf_size > SCREEN.buf_size) {
-		// create new buffer if it doesn't exist yet or we are increasing pixel count
+	SCREEN.stride = SCREEN_STRIDE(SCREEN);
+	size_t buf_size = SCREEN.stride * SCREEN.h;
+	if (!SCREEN.buf || buf_size != SCREEN.buf_size) {
 		FREE(SCREEN.buf);
-		SCREEN.buf = calloc(1, buf_size);
+		SCREEN.buf = malloc(buf_size * sizeof(*SCREEN.buf));
 		if (!SCREEN.buf) goto fail;
-		needs_clear = false;
-	} else if (buf_size < SCREEN.buf_size) {
-		// realloc if we are decreasing pixel count
-		char *buf = realloc(SCREEN.buf, buf_size);
-		if (!buf) goto fail;
-		SCREEN.buf = buf;
+		SCREEN.buf_size = buf_size;
 	}
+	memset(SCREEN.buf, 0x00, SCREEN.buf_size * sizeof(*SCREEN.buf));
 
 	bool resize = false;
-	if (buf_size != SCREEN.buf_size) resize = true;
-
-	SCREEN.buf_size = buf_size;
-
-	if (needs_clear) memset(SCREEN.buf, 0x00, SCREEN.buf_size);
+	if (!display.glyphs[0] || !poss_eq(display.glyphs_size, display.term_size)) {
+		for (unsigned i = 0; i < 2; ++i) {
+			FREE(display.glyphs[i]);
+			display.glyphs[i] = calloc(display.term_size.x * display.term_size.y + GLYPH_SLACK, 1); // blank, since the screen is cleared below
+			if (!display.glyphs[i]) goto fail;
+		}
+		display.glyphs_size = display.term_size;
+		resize = true;
+	}
 
 	float total_length = 0;
-	for (unsigned i = 0; i < system->count; ++i) total_length += system->chain[i].length;
+	for (unsigned i = 0; i < system->count; ++i) total_length += system->length[i];
 
 	struct rectf
 	        rect_from = RECTF(-total_length, -total_length, total_length * 2, total_length * 2), // max distance the pendulum can reach
@@ -139,83 +446,80 @@ bool display_render(struct pendulum_system *system, const char *info) {
 
 	struct posf pend_t = POSF(0, 0);
 	for (unsigned i = 0; i < system->count; ++i) {
-		struct pendulum *p = &system->chain[i];
 		struct posf pend_f = pend_t;
-		pend_t.x += sin(p->angle) * p->length;
-		pend_t.y += cos(p->angle) * p->length;
+		pend_t.x += sin(system->angle[i]) * system->length[i];
+		pend_t.y += cos(system->angle[i]) * system->length[i];
 
-		// draw line
+		// draw line, clipped first so the cost only depends on the pixels that are visible
 		struct posf cell_f = map_rectf(pend_f, rect_from, rect_to),
-		            cell_t = map_rectf(pend_t, rect_from, rect_to),
-		            delta = posf_sub(cell_t, cell_f);
-		if (delta.x == 0 && delta.y == 0) break;
-		bool swap = fabsf(delta.y) > fabsf(delta.x);
-		if (swap) { // swap x and y if gradient > 1 (45° from horizontal), otherwise there will be gaps since it loops over x-values
-			SWAP_POSF(cell_f);
-			SWAP_POSF(cell_t);
-			SWAP_POSF(delta);
-		}
-		float gradient = delta.y / delta.x;
-		if (delta.x < 0) SWAP(struct posf, cell_f, cell_t); // swap from/to values to make it easier to loop
-		for (size_t x = floorf(cell_f.x); x <= ceilf(cell_t.x); ++x) {
-			struct poss cell = POSS(x, roundf(gradient * (cell.x - cell_f.x) + cell_f.y)); // y=m*(x-x1)+y1
-			if (swap) SWAP_POSS(cell);
-			SET_CELL(cell, 1, SCREEN);
-		}
+		            cell_t = map_rectf(pend_t, rect_from, rect_to);
+		if (!SCREEN.w || !SCREEN.h || !clip_line(&cell_f, &cell_t, POSF(SCREEN.w - 1, SCREEN.h - 1))) continue;
+		// clipping can be off by a rounding error, so clamp too
+		long x0 = lroundf(fminf(cell_f.x, SCREEN.w - 1)), y0 = lroundf(fminf(cell_f.y, SCREEN.h - 1)),
+		     x1 = lroundf(fminf(cell_t.x, SCREEN.w - 1)), y1 = lroundf(fminf(cell_t.y, SCREEN.h - 1));
+		draw_line(&SCREEN, x0 < 0 ? 0 : x0, y0 < 0 ? 0 : y0, x1 < 0 ? 0 : x1, y1 < 0 ? 0 : y1);
 	}
+	PROF_END(raster, PROF_RASTER);
 
-	if (resize) eprintf("\x1b[2J"); // clear on resize
+	PROF_BEGIN(write);
+	if (resize) oprintf("\x1b[2J"); // clear on resize
+	size_t info_rows = 0;
 	if (info) {
-		eprintf("\x1b[H");
+		oprintf("\x1b[H");
 		const char *newline;
 		do {
 			newline = strchr(info, '\n');
 			size_t nbyte = newline ? newline - info : strlen(info);
-			eprintf("\x1b[2K");                                     // clear line
-			if (nbyte != write(DISPLAY_FD, info, nbyte)) goto fail; // write up until first newline
-			eprintf("\x1b[E");                                      // next line
+			oprintf("\x1b[2K");                           // clear line
+			if (!output_append(info, nbyte)) goto fail; // up until first newline
+			oprintf("\x1b[E");                            // next line
 			info = newline + 1;
+			++info_rows;
 		} while (newline);
 	}
+	if (info_rows > display.term_size.y) info_rows = display.term_size.y;
+	display.cursor.x = CURSOR_UNKNOWN;
 
-	struct poss cursor = POSS2(0);
+	// the info rows were just cleared, but blanks aren't drawn over the text in them
+	unsigned char *last = display.glyphs[0], *glyphs = display.glyphs[1];
+	memset(last, 0, info_rows * display.term_size.x);
 
+	// each terminal cell covers an aligned pair of bits in each of its rows of the bitmap, since the width is even
+	// so each byte of a row covers 4 cells, which the lookup tables turn into their glyph bits at once
+	// cells past the end of a row are blank and land in the next row before it's filled, or in the slack
+	if (glyph_lut_mode != display.mode) build_glyph_lut(display.mode);
 	struct poss term;
-	for (term.y = 0; term.y < display.term_size.y; ++term.y)
-		for (term.x = 0; term.x < display.term_size.x; ++term.x) {
-			struct poss cell = poss_mul(term, block_size);
-
-			static const char *chars[] = {" ", "▘", "▝", "▀", "▖", "▌", "▞", "▛", "▗", "▚", "▐", "▜", "▄", "▙", "▟", "█"};
-			unsigned char index = 0;
-			struct poss block;
-			for (block.y = 0; block.y < block_size.y; ++block.y)
-				for (block.x = 0; block.x < block_size.x; ++block.x)
-					if (GET_CELL(poss_add(cell, block), SCREEN))
-						index |= 1 << (block.y * block_size.x + block.x); // set corresponding bit for the block character
-
-			if (index == 0) {
-				if (SCREEN_OTHER.buf)
-					for (block.y = 0; block.y < block_size.y; ++block.y)
-						for (block.x = 0; block.x < block_size.x; ++block.x)
-							if (GET_CELL(poss_add(cell, block), SCREEN_OTHER))
-								goto draw_char; // override previous character
-				// skip drawing empty space
-				continue;
+	for (term.y = 0; term.y < display.term_size.y; ++term.y) {
+		unsigned char *row = glyphs + term.y * display.term_size.x;
+		const uint64_t *pixels = SCREEN.buf + term.y * block_size.y * SCREEN.stride;
+		for (size_t word = 0; word < SCREEN.stride; ++word)
+			for (unsigned byte = 0; byte < 8; ++byte) {
+				uint32_t cells = 0;
+				for (unsigned y = 0; y < block_size.y; ++y) cells |= glyph_lut[y][(pixels[y * SCREEN.stride + word] >> (byte * 8)) & 0xff];
+				unsigned char *out = row + word * 32 + byte * 4;
+				out[0] = cells, out[1] = cells >> 8, out[2] = cells >> 16, out[3] = cells >> 24;
 			}
+	}
 
-		draw_char:
-			const char *c = chars[index];
-			(void) c;
-			if (!poss_eq(term, cursor)) {
-				eprintf("\x1b[%zu;%zuH", term.y + 1, term.x + 1);
-				cursor.x = term.x, cursor.y = term.y;
-			}
-			eprintf("%s", c);
-			++cursor.x;
+	for (term.y = 0; term.y < display.term_size.y; ++term.y) {
+		const unsigned char *row = glyphs + term.y * display.term_size.x, *last_row = last + term.y * display.term_size.x;
+		if (!memcmp(row, last_row, display.term_size.x)) continue;
+
+		bool overwrite = term.y >= info_rows; // don't write blanks over the info text
+		for (term.x = 0; term.x < display.term_size.x; ++term.x) {
+			if (row[term.x] == last_row[term.x]) continue;
+			if (!poss_eq(term, display.cursor) && !move_cursor(term, row, overwrite)) goto fail;
+			if (!output_glyph(row[term.x])) goto fail;
+			// the cursor stays on the last column instead of wrapping
+			display.cursor.x = term.x + 1 < display.term_size.x ? term.x + 1 : CURSOR_UNKNOWN;
 		}
+	}
+	display.glyphs[0] = glyphs, display.glyphs[1] = last;
+
+	if (!output_flush()) goto fail;
+	PROF_END(write, PROF_WRITE);
 
 	res = true;
 fail:
-	fsync(DISPLAY_FD);
 	return res;
 }
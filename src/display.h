@@ -2,6 +2,15 @@
 #define DISPLAY_H
 #include "sim.h"
 #include <stdbool.h>
+
+enum display_mode {
+	DISPLAY_QUADRANTS, // 2x2 pixels per cell with the quadrant block characters
+	DISPLAY_BRAILLE,   // 2x4 pixels per cell with braille patterns, which need a font that has them
+};
+
+void display_set_output(int fd, size_t columns, size_t rows); // instead of the terminal on stdout, for benchmarks
+void display_set_mode(enum display_mode mode);
+void display_resize(void); // the terminal size changed, async-signal-safe so it can be called from the SIGWINCH handler
 bool display_enable(bool debug);
 bool display_disable(bool debug);
 bool display_render(struct pendulum_system *system, const char *info);
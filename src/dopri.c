@@ -0,0 +1,175 @@
+#include "dopri.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Hairer, Nørsett and Wanner, Solving Ordinary Differential Equations I, section II.5 and II.6
+
+#define MAX_STEPS 100000 // per call, in case the step size collapses
+
+static const double
+        c2 = 1 / 5.0, c3 = 3 / 10.0, c4 = 4 / 5.0, c5 = 8 / 9.0,
+        a21 = 1 / 5.0,
+        a31 = 3 / 40.0, a32 = 9 / 40.0,
+        a41 = 44 / 45.0, a42 = -56 / 15.0, a43 = 32 / 9.0,
+        a51 = 19372 / 6561.0, a52 = -25360 / 2187.0, a53 = 64448 / 6561.0, a54 = -212 / 729.0,
+        a61 = 9017 / 3168.0, a62 = -355 / 33.0, a63 = 46732 / 5247.0, a64 = 49 / 176.0, a65 = -5103 / 18656.0,
+        a71 = 35 / 384.0, a73 = 500 / 1113.0, a74 = 125 / 192.0, a75 = -2187 / 6784.0, a76 = 11 / 84.0,
+        // difference between the 5th and 4th order solutions
+        e1 = 71 / 57600.0, e3 = -71 / 16695.0, e4 = 71 / 1920.0, e5 = -17253 / 339200.0, e6 = 22 / 525.0, e7 = -1 / 40.0,
+        // dense output
+        d1 = -12715105075 / 11282082432.0, d3 = 87487479700 / 32700410799.0, d4 = -10690763975 / 1880347072.0,
+        d5 = 701980252875 / 199316789632.0, d6 = -1453857185 / 822651844.0, d7 = 69997945 / 29380423.0;
+
+bool dopri_init(struct dopri *dopri, unsigned n, double atol, double rtol) {
+	*dopri = (struct dopri) {.n = n, .atol = atol, .rtol = rtol};
+	double *buf = calloc((size_t) n * 15, sizeof(*buf));
+	if (!buf) return false;
+	dopri->memory = dopri->y = buf;
+	dopri->y_new = buf + n;
+	for (unsigned i = 0; i < 7; ++i) dopri->k[i] = buf + n * (2 + i);
+	for (unsigned i = 0; i < 5; ++i) dopri->cont[i] = buf + n * (9 + i);
+	dopri->out = buf + n * 14;
+	return true;
+}
+
+void dopri_free(struct dopri *dopri) {
+	FREE(dopri->memory);
+}
+
+void dopri_reset(struct dopri *dopri, double t, const double *y) {
+	memcpy(dopri->y, y, dopri->n * sizeof(*y));
+	memcpy(dopri->out, y, dopri->n * sizeof(*y));
+	dopri->t = dopri->t_prev = dopri->t_out = t;
+	dopri->h = 0;
+	dopri->fsal = false;
+}
+
+static double scale(const struct dopri *dopri, double a, double b) {
+	return dopri->atol + dopri->rtol * fmax(fabs(a), fabs(b));
+}
+
+// initial step size, from the size of the solution and its first two derivatives
+static double initial_step(struct dopri *dopri, void dydt(double t, double u[], double f[], void *ctx), void *ctx) {
+	unsigned n = dopri->n;
+	double *y = dopri->y, *f0 = dopri->k[0], *y1 = dopri->y_new, *f1 = dopri->k[1];
+	double dy = 0, df = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		double sk = scale(dopri, y[i], y[i]);
+		dy += (y[i] / sk) * (y[i] / sk);
+		df += (f0[i] / sk) * (f0[i] / sk);
+	}
+	dy = sqrt(dy / n), df = sqrt(df / n);
+	double h0 = dy < 1e-5 || df < 1e-5 ? 1e-6 : 0.01 * dy / df;
+
+	// explicit Euler step to estimate the second derivative
+	for (unsigned i = 0; i < n; ++i) y1[i] = y[i] + h0 * f0[i];
+	dydt(dopri->t + h0, y1, f1, ctx);
+	++dopri->evaluations;
+	double ddf = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		double d = (f1[i] - f0[i]) / scale(dopri, y[i], y[i]);
+		ddf += d * d;
+	}
+	ddf = sqrt(ddf / n) / h0;
+
+	double max = fmax(df, ddf);
+	double h1 = max <= 1e-15 ? fmax(1e-6, h0 * 1e-3) : pow(0.01 / max, 1 / 5.0);
+	return fmin(100 * h0, h1);
+}
+
+// attempts one step of size h, leaving the new solution in y_new, returning the scaled error norm
+static double try_step(struct dopri *dopri, void dydt(double t, double u[], double f[], void *ctx), void *ctx, double h) {
+	unsigned n = dopri->n;
+	double t = dopri->t, *y = dopri->y, *y1 = dopri->y_new;
+	double *k1 = dopri->k[0], *k2 = dopri->k[1], *k3 = dopri->k[2], *k4 = dopri->k[3], *k5 = dopri->k[4], *k6 = dopri->k[5], *k7 = dopri->k[6];
+
+	for (unsigned i = 0; i < n; ++i) y1[i] = y[i] + h * a21 * k1[i];
+	dydt(t + c2 * h, y1, k2, ctx);
+	for (unsigned i = 0; i < n; ++i) y1[i] = y[i] + h * (a31 * k1[i] + a32 * k2[i]);
+	dydt(t + c3 * h, y1, k3, ctx);
+	for (unsigned i = 0; i < n; ++i) y1[i] = y[i] + h * (a41 * k1[i] + a42 * k2[i] + a43 * k3[i]);
+	dydt(t + c4 * h, y1, k4, ctx);
+	for (unsigned i = 0; i < n; ++i) y1[i] = y[i] + h * (a51 * k1[i] + a52 * k2[i] + a53 * k3[i] + a54 * k4[i]);
+	dydt(t + c5 * h, y1, k5, ctx);
+	for (unsigned i = 0; i < n; ++i) y1[i] = y[i] + h * (a61 * k1[i] + a62 * k2[i] + a63 * k3[i] + a64 * k4[i] + a65 * k5[i]);
+	dydt(t + h, y1, k6, ctx);
+	for (unsigned i = 0; i < n; ++i) y1[i] = y[i] + h * (a71 * k1[i] + a73 * k3[i] + a74 * k4[i] + a75 * k5[i] + a76 * k6[i]);
+	dydt(t + h, y1, k7, ctx); // the derivative at the end of the step, which is also the first stage of the next one
+	dopri->evaluations += 6;
+
+	double err = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		double e = h * (e1 * k1[i] + e3 * k3[i] + e4 * k4[i] + e5 * k5[i] + e6 * k6[i] + e7 * k7[i]) / scale(dopri, y[i], y1[i]);
+		err += e * e;
+	}
+	return sqrt(err / n);
+}
+
+// interpolation coefficients for the step just taken, from y to y_new
+static void prepare_dense(struct dopri *dopri, double h) {
+	double *y = dopri->y, *y1 = dopri->y_new, **k = dopri->k, **cont = dopri->cont;
+	for (unsigned i = 0; i < dopri->n; ++i) {
+		double diff = y1[i] - y[i], bspl = h * k[0][i] - diff;
+		cont[0][i] = y[i];
+		cont[1][i] = diff;
+		cont[2][i] = bspl;
+		cont[3][i] = diff - h * k[6][i] - bspl;
+		cont[4][i] = h * (d1 * k[0][i] + d3 * k[2][i] + d4 * k[3][i] + d5 * k[4][i] + d6 * k[5][i] + d7 * k[6][i]);
+	}
+}
+
+static bool step(struct dopri *dopri, void dydt(double t, double u[], double f[], void *ctx), void *ctx) {
+	if (!dopri->fsal) {
+		dydt(dopri->t, dopri->y, dopri->k[0], ctx);
+		++dopri->evaluations;
+		dopri->fsal = true;
+	}
+	if (dopri->h <= 0) dopri->h = initial_step(dopri, dydt, ctx);
+
+	bool rejected = false;
+	for (;;) {
+		double h = dopri->h;
+		if (dopri->t + h == dopri->t) return false; // step size underflow
+
+		double err = try_step(dopri, dydt, ctx, h);
+		if (!isfinite(err)) err = 1e10;
+
+		// standard controller, not growing straight after a rejection
+		double fac = 0.9 * pow(fmax(err, 1e-10), -1 / 5.0);
+		fac = fmin(rejected ? 1 : 10, fmax(0.2, fac));
+		dopri->h = h * fac;
+
+		if (err <= 1) {
+			prepare_dense(dopri, h);
+			dopri->t_prev = dopri->t;
+			dopri->t += h;
+			SWAP(double *, dopri->y, dopri->y_new);
+			SWAP(double *, dopri->k[0], dopri->k[6]);
+			++dopri->accepted;
+			return true;
+		}
+		++dopri->rejected;
+		rejected = true;
+	}
+}
+
+bool dopri_advance(struct dopri *dopri, void dydt(double t, double u[], double f[], void *ctx), void *ctx, double t_out) {
+	if (t_out < dopri->t_prev) return false;
+
+	for (unsigned steps = 0; dopri->t < t_out; ++steps)
+		if (steps >= MAX_STEPS || !step(dopri, dydt, ctx)) return false;
+
+	dopri->t_out = t_out;
+	if (t_out == dopri->t) {
+		memcpy(dopri->out, dopri->y, dopri->n * sizeof(*dopri->out));
+		return true;
+	}
+
+	double s = (t_out - dopri->t_prev) / (dopri->t - dopri->t_prev), s1 = 1 - s;
+	double **cont = dopri->cont;
+	for (unsigned i = 0; i < dopri->n; ++i)
+		dopri->out[i] = cont[0][i] + s * (cont[1][i] + s1 * (cont[2][i] + s * (cont[3][i] + s1 * cont[4][i])));
+	return true;
+}
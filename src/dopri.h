@@ -0,0 +1,24 @@
+#ifndef DOPRI_H
+#define DOPRI_H
+#include <stdbool.h>
+
+// Dormand–Prince 5(4) with step size control and dense output
+// the integrator keeps its own solution and steps past the requested times, interpolating back to them
+struct dopri {
+	unsigned n;
+	double atol, rtol;
+	double t, t_prev, h; // y is the solution at t, the last step started at t_prev, h is the next step to try
+	double t_out, *out;  // the solution last asked for
+	double *y, *y_new, *k[7], *cont[5]; // swapped around between steps
+	double *memory;                      // owns the buffers above
+	bool fsal; // k[0] already holds the derivative at t
+	unsigned long evaluations, accepted, rejected;
+};
+
+bool dopri_init(struct dopri *dopri, unsigned n, double atol, double rtol);
+void dopri_reset(struct dopri *dopri, double t, const double *y); // start again from a new state, keeping the tolerances
+// integrate up to t_out, which must not be before the start of the last step, and put the solution there in out
+// ctx is passed through to dydt
+bool dopri_advance(struct dopri *dopri, void dydt(double t, double u[], double f[], void *ctx), void *ctx, double t_out);
+void dopri_free(struct dopri *dopri);
+#endif
@@ -0,0 +1,142 @@
+#include "ensemble.h"
+#include "chain.h"
+#include "util.h"
+#ifdef SIM_KERNEL
+#include "kernel.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned ensemble_params(const struct sim_ensemble *ensemble) { return 1 + ensemble->system->count * 2; }
+static unsigned ensemble_vars(const struct sim_ensemble *ensemble) { return ensemble->system->count * 2; }
+
+static double *lane(double *array, unsigned per_block, unsigned index, unsigned offset) {
+	return &array[((index / VM_LANES) * per_block + offset) * VM_LANES + index % VM_LANES];
+}
+
+double *ensemble_gravity(struct sim_ensemble *ensemble, unsigned index) {
+	return lane(ensemble->params, ensemble_params(ensemble), index, 0);
+}
+double *ensemble_mass(struct sim_ensemble *ensemble, unsigned index, unsigned pendulum) {
+	return lane(ensemble->params, ensemble_params(ensemble), index, 1 + pendulum);
+}
+double *ensemble_length(struct sim_ensemble *ensemble, unsigned index, unsigned pendulum) {
+	return lane(ensemble->params, ensemble_params(ensemble), index, 1 + ensemble->system->count + pendulum);
+}
+double *ensemble_angle(struct sim_ensemble *ensemble, unsigned index, unsigned pendulum) {
+	return lane(ensemble->state, ensemble_vars(ensemble), index, pendulum);
+}
+double *ensemble_angvel(struct sim_ensemble *ensemble, unsigned index, unsigned pendulum) {
+	return lane(ensemble->state, ensemble_vars(ensemble), index, ensemble->system->count + pendulum);
+}
+
+bool ensemble_init(struct sim_ensemble *ensemble, struct pendulum_system *system, unsigned size) {
+	ensemble->system = system;
+	ensemble->size = size;
+	ensemble->blocks = (size + VM_LANES - 1) / VM_LANES;
+
+	unsigned params = ensemble_params(ensemble), vars = ensemble_vars(ensemble), count = system->count;
+	ensemble->params = calloc((size_t) ensemble->blocks * params * VM_LANES, sizeof(*ensemble->params));
+	ensemble->state = calloc((size_t) ensemble->blocks * vars * VM_LANES, sizeof(*ensemble->state));
+	// four derivatives and the intermediate state for RK4, then one lane of inputs for the numeric engine
+	ensemble->scratch = calloc(vars * VM_LANES * 5 + params + vars + count + CHAIN_SCRATCH(count), sizeof(*ensemble->scratch));
+	if (!ensemble->params || !ensemble->state || !ensemble->scratch) goto fail;
+
+	if (system->engine == SIM_ENGINE_SYMBOLIC && !system->kernel) {
+		ensemble->regs = tape_regs_new(&system->tape_angacc, VM_LANES);
+		if (!ensemble->regs) goto fail;
+	}
+
+	// the padding at the end of the last block is simulated too, so fill it with something sensible
+	for (unsigned i = 0; i < ensemble->blocks * VM_LANES; ++i) {
+		*ensemble_gravity(ensemble, i) = system->gravity;
+		for (unsigned j = 0; j < count; ++j) {
+			*ensemble_mass(ensemble, i, j) = system->mass[j];
+			*ensemble_length(ensemble, i, j) = system->length[j];
+			*ensemble_angle(ensemble, i, j) = system->angle[j];
+			*ensemble_angvel(ensemble, i, j) = system->angvel[j];
+		}
+	}
+	return true;
+
+fail:
+	ensemble_free(ensemble);
+	return false;
+}
+
+void ensemble_free(struct sim_ensemble *ensemble) {
+	FREE(ensemble->params);
+	FREE(ensemble->state);
+	FREE(ensemble->scratch);
+	FREE(ensemble->regs);
+}
+
+// angular accelerations of one block, laid out as [pendulum][lane]
+static void angacc_batch(struct sim_ensemble *ensemble, const double *params, const double *y, double *angacc) {
+	const struct pendulum_system *system = ensemble->system;
+	unsigned nparams = ensemble_params(ensemble), vars = ensemble_vars(ensemble), count = system->count;
+
+	if (system->engine == SIM_ENGINE_NUMERIC) {
+		// the tridiagonal solve doesn't vectorise across lanes, so evaluate each trajectory separately
+		double *lane_params = ensemble->scratch + vars * VM_LANES * 5, *lane_y = lane_params + nparams,
+		       *lane_angacc = lane_y + vars, *chain_scratch = lane_angacc + count;
+		for (unsigned l = 0; l < VM_LANES; ++l) {
+			for (unsigned i = 0; i < nparams; ++i) lane_params[i] = params[i * VM_LANES + l];
+			for (unsigned i = 0; i < vars; ++i) lane_y[i] = y[i * VM_LANES + l];
+			chain_angacc(count, lane_params, lane_y, lane_angacc, chain_scratch);
+			for (unsigned i = 0; i < count; ++i) angacc[i * VM_LANES + l] = lane_angacc[i];
+		}
+		return;
+	}
+
+#ifdef SIM_KERNEL
+	if (system->kernel) {
+		kernel_angacc_batch(params, y, angacc);
+		return;
+	}
+#endif
+
+	// the tape inputs have the same layout as the parameters followed by the state
+	double *regs = ensemble->regs;
+	memcpy(regs, params, nparams * VM_LANES * sizeof(*regs));
+	memcpy(regs + nparams * VM_LANES, y, vars * VM_LANES * sizeof(*regs));
+	tape_run_batch(&system->tape_angacc, regs);
+	for (unsigned i = 0; i < count; ++i) memcpy(&angacc[i * VM_LANES], &regs[system->tape_angacc.output[i] * VM_LANES], VM_LANES * sizeof(*regs));
+}
+
+static void dydt_batch(struct sim_ensemble *ensemble, const double *params, const double *y, double *out) {
+	unsigned count = ensemble->system->count;
+	memcpy(out, y + count * VM_LANES, count * VM_LANES * sizeof(*out)); // angle changes by angular velocity
+	angacc_batch(ensemble, params, y, out + count * VM_LANES);         // angular velocity changes by angular acceleration
+}
+
+// the same arithmetic as rk4(), so each lane follows the trajectory sim_step() would give it
+VM_TARGET_CLONES static void step_block(struct sim_ensemble *ensemble, double *params, double *y, int steps, double dt) {
+	unsigned n = ensemble_vars(ensemble) * VM_LANES;
+	double *restrict f0 = ensemble->scratch, *restrict f1 = f0 + n, *restrict f2 = f1 + n, *restrict f3 = f2 + n, *restrict u = f3 + n;
+
+	for (int j = 0; j < steps; ++j) {
+		dydt_batch(ensemble, params, y, f0);
+		for (unsigned i = 0; i < n; ++i) u[i] = y[i] + dt * f0[i] / 2.0;
+		dydt_batch(ensemble, params, u, f1);
+		for (unsigned i = 0; i < n; ++i) u[i] = y[i] + dt * f1[i] / 2.0;
+		dydt_batch(ensemble, params, u, f2);
+		for (unsigned i = 0; i < n; ++i) u[i] = y[i] + dt * f2[i];
+		dydt_batch(ensemble, params, u, f3);
+		for (unsigned i = 0; i < n; ++i) y[i] = y[i] + dt * (f0[i] + 2.0 * f1[i] + 2.0 * f2[i] + f3[i]) / 6.0;
+	}
+}
+
+bool sim_step_batch(struct sim_ensemble *ensemble, int steps, double time_span) {
+	if (steps < 1) return false;
+	if (time_span <= 0) return false;
+
+	unsigned params = ensemble_params(ensemble), vars = ensemble_vars(ensemble);
+	double dt = time_span / (double) steps;
+
+	// finish all the steps of one block before moving on, so its state stays in cache
+	for (unsigned b = 0; b < ensemble->blocks; ++b)
+		step_block(ensemble, &ensemble->params[(size_t) b * params * VM_LANES], &ensemble->state[(size_t) b * vars * VM_LANES], steps, dt);
+
+	return true;
+}
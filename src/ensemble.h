@@ -0,0 +1,25 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+#include <stdbool.h>
+#include "sim.h"
+
+// many copies of one pendulum system, each with its own parameters and initial conditions, advanced VM_LANES at a time
+// arrays are laid out as [block][index][lane], so the same variable of neighbouring trajectories is contiguous
+struct sim_ensemble {
+	struct pendulum_system *system; // provides the equations of motion, must be initialised and outlive the ensemble
+	unsigned size, blocks;
+	double *params; // gravity, then the mass of each pendulum, then the length of each
+	double *state;  // angle of each pendulum, then the angular velocity of each
+	double *scratch, *regs;
+};
+
+// every member starts as a copy of the system, use the accessors below to change them
+bool ensemble_init(struct sim_ensemble *ensemble, struct pendulum_system *system, unsigned size);
+double *ensemble_gravity(struct sim_ensemble *ensemble, unsigned index);
+double *ensemble_mass(struct sim_ensemble *ensemble, unsigned index, unsigned pendulum);
+double *ensemble_length(struct sim_ensemble *ensemble, unsigned index, unsigned pendulum);
+double *ensemble_angle(struct sim_ensemble *ensemble, unsigned index, unsigned pendulum);
+double *ensemble_angvel(struct sim_ensemble *ensemble, unsigned index, unsigned pendulum);
+bool sim_step_batch(struct sim_ensemble *ensemble, int steps, double time_span);
+void ensemble_free(struct sim_ensemble *ensemble);
+#endif
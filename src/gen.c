@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "sim.h"
+
+#include "config.h"
+
+// derives the equations of motion for the chain in config.h once and writes them out as straight-line C, see kernel.h
+
+struct gen {
+	FILE *file;
+	const struct tape *tape;
+	unsigned params;
+	bool *needed;
+	bool batch; // inside a loop over lanes, with inputs laid out as [input][lane]
+};
+
+static void operand(struct gen *gen, unsigned reg) {
+	const char *lane = gen->batch ? " * VM_LANES + l" : "";
+	if (reg < gen->params) fprintf(gen->file, "params[%u%s]", reg, lane);
+	else if (reg < gen->tape->inputs) fprintf(gen->file, "y[%u%s]", reg - gen->params, lane);
+	else fprintf(gen->file, "r%u", reg);
+}
+
+// whether anything reads a result of the instruction
+static bool instr_needed(const struct gen *gen, const struct tape_instr *in) {
+	return gen->needed[in->out] || (in->op == TAPE_SINCOS && gen->needed[in->out + 1]);
+}
+
+// writes the instructions needed to compute the given outputs
+static void body(struct gen *gen, const unsigned *outputs, unsigned count) {
+	const struct tape *tape = gen->tape;
+	memset(gen->needed, 0, tape->registers * sizeof(*gen->needed));
+	for (unsigned i = 0; i < count; ++i) gen->needed[outputs[i]] = true;
+	for (unsigned i = tape->length; i-- > 0;) {
+		const struct tape_instr *in = &tape->code[i];
+		if (!instr_needed(gen, in)) continue;
+		gen->needed[in->a] = true;
+		if (in->op != TAPE_NEG && in->op != TAPE_SINCOS) gen->needed[in->b] = true;
+	}
+
+	const char *indent = gen->batch ? "\t\t" : "\t";
+	for (unsigned i = 0; i < tape->constants; ++i) {
+		const struct tape_const *c = &tape->constant[i];
+		if (gen->needed[c->reg]) fprintf(gen->file, "%sconst double r%u = %.17g;\n", indent, c->reg, c->value);
+	}
+
+	for (unsigned i = 0; i < tape->length; ++i) {
+		const struct tape_instr *in = &tape->code[i];
+		if (!instr_needed(gen, in)) continue;
+
+		if (in->op == TAPE_SINCOS) {
+			fprintf(gen->file, "%sdouble r%u, r%u;\n%s%s(", indent, in->out, in->out + 1, indent, gen->batch ? "vm_sincos" : "sincos");
+			operand(gen, in->a);
+			fprintf(gen->file, ", &r%u, &r%u);\n", in->out, in->out + 1);
+			continue;
+		}
+
+		static const char *format[][3] = {
+		        [TAPE_ADD] = {"", " + ", ""},
+		        [TAPE_SUB] = {"", " - ", ""},
+		        [TAPE_MUL] = {"", " * ", ""},
+		        [TAPE_DIV] = {"", " / ", ""},
+		        [TAPE_NEG] = {"-", NULL, ""},
+		        [TAPE_POW] = {"pow(", ", ", ")"},
+		};
+		fprintf(gen->file, "%sconst double r%u = %s", indent, in->out, format[in->op][0]);
+		operand(gen, in->a);
+		if (format[in->op][1]) {
+			fputs(format[in->op][1], gen->file);
+			operand(gen, in->b);
+		}
+		fprintf(gen->file, "%s;\n", format[in->op][2]);
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		fprintf(stderr, "%s <output.c>\n", argc ? argv[0] : "dpend-gen");
+		return 1;
+	}
+
+	struct pendulum_system system = {0};
+	CONFIGURE(system);
+
+	if (!sim_init(&system)) {
+		fprintf(stderr, "Failed to initialise simulation\n");
+		return 3;
+	}
+
+	int ret = 1;
+	struct gen gen = {.params = 1 + system.count * 2};
+	gen.needed = calloc(system.tape_angacc.registers + system.tape_energy.registers, sizeof(*gen.needed));
+	if (!gen.needed) goto fail;
+
+	gen.file = fopen(argv[1], "w");
+	if (!gen.file) {
+		perror(argv[1]);
+		goto fail;
+	}
+
+	fprintf(gen.file, "// generated by dpend-gen, do not edit\n"
+	                  "#define _GNU_SOURCE // sincos\n"
+	                  "#include <math.h>\n"
+	                  "#include \"kernel.h\"\n"
+	                  "#include \"vmath.h\"\n\n"
+	                  "const unsigned kernel_count = %u;\n\n",
+	        system.count);
+
+	gen.tape = &system.tape_angacc;
+	fprintf(gen.file, "void kernel_angacc(const double *params, const double *y, double *angacc) {\n");
+	body(&gen, gen.tape->output, gen.tape->outputs);
+	for (unsigned i = 0; i < gen.tape->outputs; ++i) {
+		fprintf(gen.file, "\tangacc[%u] = ", i);
+		operand(&gen, gen.tape->output[i]);
+		fprintf(gen.file, ";\n");
+	}
+	fprintf(gen.file, "}\n");
+
+	gen.batch = true;
+	fprintf(gen.file, "\nVM_TARGET_CLONES void kernel_angacc_batch(const double *restrict params, const double *restrict y, double *restrict angacc) {\n"
+	                  "\tfor (unsigned l = 0; l < VM_LANES; ++l) {\n");
+	body(&gen, gen.tape->output, gen.tape->outputs);
+	for (unsigned i = 0; i < gen.tape->outputs; ++i) {
+		fprintf(gen.file, "\t\tangacc[%u * VM_LANES + l] = ", i);
+		operand(&gen, gen.tape->output[i]);
+		fprintf(gen.file, ";\n");
+	}
+	fprintf(gen.file, "\t}\n}\n");
+	gen.batch = false;
+
+	gen.tape = &system.tape_energy;
+	static const char *energy[] = {"ke", "gpe"};
+	for (unsigned i = 0; i < 2; ++i) {
+		fprintf(gen.file, "\ndouble kernel_%s(const double *params, const double *y) {\n", energy[i]);
+		body(&gen, &gen.tape->output[i], 1);
+		fprintf(gen.file, "\treturn ");
+		operand(&gen, gen.tape->output[i]);
+		fprintf(gen.file, ";\n}\n");
+	}
+
+	if (ferror(gen.file)) goto fail;
+	ret = 0;
+fail:
+	if (gen.file && fclose(gen.file)) ret = 1;
+	free(gen.needed);
+	sim_free(&system);
+	sim_state_free(&system);
+	return ret;
+}
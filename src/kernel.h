@@ -0,0 +1,13 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+// generated by out/dpend-gen for the chain configured in config.h, used by sim.c when built with SIM_KERNEL
+
+// params holds gravity, then the mass of each pendulum, then the length of each
+// y holds the angle of each pendulum, then the angular velocity of each
+extern const unsigned kernel_count;
+void kernel_angacc(const double *params, const double *y, double *angacc);
+// the same for VM_LANES chains at once, with every array laid out as [index][lane]
+void kernel_angacc_batch(const double *restrict params, const double *restrict y, double *restrict angacc);
+double kernel_ke(const double *params, const double *y);
+double kernel_gpe(const double *params, const double *y);
+#endif
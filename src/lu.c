@@ -0,0 +1,46 @@
+#include "lu.h"
+#include <math.h>
+
+bool lu_factor(unsigned n, double *a, unsigned *pivot) {
+	for (unsigned k = 0; k < n; ++k) {
+		unsigned max = k;
+		for (unsigned i = k + 1; i < n; ++i)
+			if (fabs(a[i * n + k]) > fabs(a[max * n + k])) max = i;
+		pivot[k] = max;
+		if (a[max * n + k] == 0) return false; // singular
+
+		if (max != k) {
+			for (unsigned j = 0; j < n; ++j) {
+				double temp = a[k * n + j];
+				a[k * n + j] = a[max * n + j];
+				a[max * n + j] = temp;
+			}
+		}
+
+		for (unsigned i = k + 1; i < n; ++i) {
+			double factor = a[i * n + k] /= a[k * n + k];
+			for (unsigned j = k + 1; j < n; ++j) a[i * n + j] -= factor * a[k * n + j];
+		}
+	}
+	return true;
+}
+
+void lu_solve(unsigned n, const double *lu, const unsigned *pivot, const double *b, double *x) {
+	if (x != b)
+		for (unsigned i = 0; i < n; ++i) x[i] = b[i];
+
+	// apply the row swaps, then forward substitute with the unit lower triangle
+	for (unsigned k = 0; k < n; ++k) {
+		double temp = x[k];
+		x[k] = x[pivot[k]];
+		x[pivot[k]] = temp;
+	}
+	for (unsigned i = 0; i < n; ++i)
+		for (unsigned j = 0; j < i; ++j) x[i] -= lu[i * n + j] * x[j];
+
+	// back substitute with the upper triangle
+	for (unsigned i = n; i-- > 0;) {
+		for (unsigned j = i + 1; j < n; ++j) x[i] -= lu[i * n + j] * x[j];
+		x[i] /= lu[i * n + i];
+	}
+}
@@ -0,0 +1,9 @@
+#ifndef LU_H
+#define LU_H
+#include <stdbool.h>
+
+// LU decomposition with partial pivoting, for the small dense systems the integrators need solved every step
+// matrices are n by n and row-major, factorised in place
+bool lu_factor(unsigned n, double *a, unsigned *pivot);
+void lu_solve(unsigned n, const double *lu, const unsigned *pivot, const double *b, double *x);
+#endif
@@ -9,17 +9,41 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #define eprintf(...) fprintf(stderr, __VA_ARGS__)
 
 #include "display.h"
 #include "sim.h"
+#include "sweep.h"
+#include "record.h"
+#include "prof.h"
+#include "snapshot.h"
+#include "publish.h"
+#include "net.h"
+#include "util.h"
 
 #include "config.h"
 
 static bool running = false;
 
 static struct pendulum_system pendulum_system = {0};
+static struct recording replay = {0}; // played back instead of simulating when mapped
+static struct net_client remote = {.fd = -1}; // drawn instead of simulating when connected
+
+// the simulation runs on its own thread at SIMULATION_RATE, the display draws the newest snapshot it published
+static struct snapshot_buffer snapshots = {0};
+static struct pendulum_system view = {0}; // what the display draws, a copy of the state with the angles from the snapshot
+static pthread_t sim_thread;
+static bool sim_thread_running = false;
+static atomic_bool sim_quit, sim_failed;
+static unsigned steps_per_tick = STEPS_PER_TICK;
+static const char *publish_name = NULL; // also publish the state to shared memory, see publish.h
+static struct publisher publisher = {0};
+
+static void *simulate(void *arg);
 
 #define ASSERT(func, ...)     \
 	if (!(func)) {            \
@@ -32,18 +56,58 @@ static bool stop(void) {
 	running = false;
 
 	bool res = true;
+	if (sim_thread_running) {
+		atomic_store(&sim_quit, true);
+		pthread_join(sim_thread, NULL);
+		sim_thread_running = false;
+	}
 	ASSERT(display_disable(DEBUG), "Failed to deinitialise display\n");
 	ASSERT(sim_free(&pendulum_system), "Failed to deinitialise simulation\n");
+	snapshot_free(&snapshots);
+	sim_state_free(&view);
+	publish_close(&publisher);
 
 	return res;
 }
 
+static bool start_simulation(void) {
+	if (!sim_init(&pendulum_system)) return false;
+	if (!snapshot_init(&snapshots, pendulum_system.count)) return false;
+
+	view = (struct pendulum_system) {.count = pendulum_system.count};
+	if (!sim_state_alloc(&view)) return false;
+	memcpy(view.mass, pendulum_system.mass, view.count * sizeof(*view.mass));
+	memcpy(view.length, pendulum_system.length, view.count * sizeof(*view.length));
+
+	// the display always has a state to draw
+	struct snapshot *snapshot = snapshot_back(&snapshots);
+	if (!sim_energy(&pendulum_system, &snapshot->ke, &snapshot->gpe)) return false;
+	snapshot_capture(snapshot, &pendulum_system);
+	memcpy(snapshot->last_angle, snapshot->angle, pendulum_system.count * sizeof(*snapshot->angle));
+	snapshot_publish(&snapshots);
+
+	if (publish_name && !publish_open(&publisher, publish_name, &pendulum_system)) {
+		perror(publish_name);
+		return false;
+	}
+
+	// signals are handled on the main thread, which stops this one before freeing anything
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	atomic_store(&sim_quit, false);
+	atomic_store(&sim_failed, false);
+	sim_thread_running = !pthread_create(&sim_thread, NULL, simulate, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return sim_thread_running;
+}
+
 static bool start(void) {
 	if (running) return true;
 	running = true;
 
 	bool res = true;
-	ASSERT(sim_init(&pendulum_system), "Failed to initialise simulation\n");
+	if (!replay.header && remote.fd < 0) ASSERT(start_simulation(), "Failed to initialise simulation\n");
 	ASSERT(display_enable(DEBUG), "Failed to initialise display\n");
 
 	if (!res) stop();
@@ -53,6 +117,7 @@ static bool start(void) {
 
 static void signal_func(int signal) {
 	if (signal == SIGWINCH) {
+		display_resize();
 		return;
 	}
 
@@ -89,7 +154,417 @@ bool nsleep(nsec_t time) {
 	return !nanosleep(&tp, NULL);
 };
 
-int main(void) {
+// steps the simulation by a fixed 1/SIMULATION_RATE seconds per tick and publishes the state after each batch of ticks, until
+// stop() asks it to quit
+// the ticks that are due are worked out from the wall clock, but never change the step size, so the trajectory is the same
+// however loaded the machine is, and at most MAX_CATCH_UP ticks are run at once so falling behind slows the simulation down
+// instead of making every batch longer than the last
+static void *simulate(void *arg) {
+	const nsec_t tick = SEC / (SIMULATION_RATE);
+	const double dt = (SIMULATION_SPEED) / (double) (SIMULATION_RATE);
+	nsec_t due = get_time() + tick; // when the next tick should run
+	unsigned long ticks = 0;
+	nsec_t last_lag = 0;
+
+	while (!atomic_load_explicit(&sim_quit, memory_order_relaxed)) {
+		nsec_t time = get_time();
+		if (time < due) {
+			nsleep(due - time);
+			continue;
+		}
+
+		struct snapshot *snapshot = snapshot_back(&snapshots);
+		bool ok = true;
+		for (unsigned i = 0; ok && i < (MAX_CATCH_UP) && due <= time; ++i, due += tick) {
+			memcpy(snapshot->last_angle, pendulum_system.angle, pendulum_system.count * sizeof(*snapshot->last_angle));
+			PROF_BEGIN(step);
+			ok = sim_step(&pendulum_system, steps_per_tick, dt);
+			PROF_END(step, PROF_STEP);
+			snapshot->due = due;
+			++ticks;
+		}
+		if (due <= time) {
+			// drop the ticks we can't catch up on
+			due = time + tick;
+			last_lag = time;
+		}
+
+		PROF_BEGIN(energy);
+		ok = ok && sim_energy(&pendulum_system, &snapshot->ke, &snapshot->gpe);
+		PROF_END(energy, PROF_ENERGY);
+		if (!ok) {
+			atomic_store(&sim_failed, true);
+			break;
+		}
+
+		if (publisher.region)
+			publish_update(&publisher, &pendulum_system, ticks, pendulum_system.steps, ticks * dt, snapshot->ke, snapshot->gpe);
+
+		snapshot_capture(snapshot, &pendulum_system);
+		snapshot->time = ticks * dt;
+		snapshot->ticks = ticks;
+		snapshot->step_time = get_time() - time;
+		snapshot->lagging = last_lag && time < last_lag + SEC;
+		snapshot_publish(&snapshots);
+	}
+	return NULL;
+}
+
+// splits the configured chain into equal links, each following the pendulum it lies along
+static struct pendulum *make_rope(struct pendulum_system *system, unsigned links) {
+	double length = 0, mass = 0;
+	for (unsigned i = 0; i < system->count; ++i) {
+		length += system->chain[i].length;
+		mass += system->chain[i].mass;
+	}
+
+	struct pendulum *rope = calloc(links, sizeof(*rope));
+	if (!rope) return NULL;
+
+	unsigned j = 0;
+	double end = system->chain[0].length;
+	for (unsigned i = 0; i < links; ++i) {
+		double pos = (i + 0.5) * length / links;
+		while (pos > end && j + 1 < system->count) end += system->chain[++j].length;
+		struct pendulum *p = &system->chain[j];
+		rope[i] = (struct pendulum) {.mass = mass / links, .length = length / links, .angle = p->angle, .angvel = p->angvel};
+	}
+	return rope;
+}
+
+static bool parse_uint(const char *str, unsigned *out) {
+	char *end;
+	unsigned long value = strtoul(str, &end, 10);
+	if (!*str || *end || value == 0 || value > UINT_MAX) return false;
+	*out = value;
+	return true;
+}
+
+static void usage(const char *name) {
+	eprintf("usage: %s [-e symbolic|numeric] [-i rk4|dopri5|symplectic|rosenbrock] [-r links] [-s steps] [-S size [-j threads] | -w file [-q] | -l socket] [-t seconds] [-P file] [-b] [-m name]\n"
+	        "       %s -p file | -c socket [-b]\n"
+	        "  -e  engine computing the equations of motion, numeric scales to long chains\n"
+	        "  -i  integrator, dopri5 picks its own step sizes to stay within the tolerances in config.h,\n"
+	        "      symplectic keeps the energy error bounded over long runs but needs -e symbolic,\n"
+	        "      rosenbrock stays stable at large steps on stiff chains (e.g. -s 1) but needs -e symbolic\n"
+	        "  -r  replace the configured chain with a rope of equal links in the same shape\n"
+	        "  -s  integration steps per tick of the simulation (default %d)\n"
+	        "  -S  instead of displaying, run a size by size grid of initial angles with rk4 and report the throughput\n"
+	        "  -j  threads for -S (default one per CPU)\n"
+	        "  -w  instead of displaying, simulate as fast as possible and record every frame to file, see record.h\n"
+	        "  -q  record floats instead of doubles\n"
+	        "  -t  simulated seconds for -S and -w (default %d)\n"
+	        "  -p  play back a recording made with -w, space pauses, arrows seek and change speed, r reverses, q quits\n"
+	        "  -P  write the phase timing histograms to file every %d s, needs PROFILE in config.h\n"
+	        "  -b  draw with braille patterns, which have twice the vertical resolution but need a font that has them\n"
+	        "  -m  publish the live state to /dev/shm/name for other processes, see publish.h and dpend-reader\n"
+	        "  -l  instead of displaying, serve the simulation to viewers on a unix socket until interrupted, see net.h\n"
+	        "  -c  draw the simulation served on a unix socket by dpend -l\n",
+	        name, name, STEPS_PER_TICK, HEADLESS_TIME, PROFILE_DUMP_INTERVAL);
+}
+
+// ticks of the simulation in time simulated seconds, times per_tick, false if that's more than an int can count
+static bool count_ticks(unsigned time, unsigned per_tick, int *out) {
+	uint64_t count = (uint64_t) per_tick * (SIMULATION_RATE) * time / (SIMULATION_SPEED);
+	if (count == 0 || count > INT_MAX) return false;
+	*out = count;
+	return true;
+}
+
+// runs the sweep with the same step size as the display would use
+static int run_sweep(unsigned size, unsigned threads, unsigned steps, unsigned time) {
+	if (pendulum_system.integrator != SIM_INTEGRATOR_RK4) {
+		eprintf("-S only supports -i rk4\n");
+		return 2;
+	}
+	int sweep_steps;
+	if (!count_ticks(time, steps, &sweep_steps)) {
+		eprintf("-s %u and -t %u make too many steps\n", steps, time);
+		return 2;
+	}
+	if (!sim_init(&pendulum_system)) {
+		eprintf("Failed to initialise simulation\n");
+		return 3;
+	}
+
+	struct sweep sweep = {
+	        .system = &pendulum_system,
+	        .width = size,
+	        .height = size,
+	        .threads = threads,
+	        .steps = sweep_steps,
+	        .time_span = time,
+	};
+	int ret = 1;
+	if (!sweep_run(&sweep)) {
+		eprintf("Failed to run sweep\n");
+		goto fail;
+	}
+
+	double trajectory_steps = (double) size * size * sweep.steps;
+	printf("%u trajectories, %d steps each: %.3f s, %.4g trajectory-steps/s\n",
+	       size * size, sweep.steps, sweep.elapsed, trajectory_steps / sweep.elapsed);
+	ret = 0;
+fail:
+	sweep_free(&sweep);
+	sim_free(&pendulum_system);
+	return ret;
+}
+
+// steps the simulation free-running, with the same step size as the display would use, recording the state after every frame
+static int run_record(const char *path, bool float32, unsigned steps, unsigned time) {
+	int frames;
+	if (!count_ticks(time, 1, &frames)) {
+		eprintf("-t %u makes too many frames\n", time);
+		return 2;
+	}
+	if (!sim_init(&pendulum_system)) {
+		eprintf("Failed to initialise simulation\n");
+		return 3;
+	}
+
+	int ret = 1;
+	double interval = (SIMULATION_SPEED) / (double) (SIMULATION_RATE);
+	struct recorder recorder;
+	if (!record_open(&recorder, path, &pendulum_system, interval, float32)) {
+		perror(path);
+		goto fail;
+	}
+
+	nsec_t start = get_time();
+	bool ok = record_write(&recorder, &pendulum_system);
+	for (int i = 0; ok && i < frames; ++i)
+		ok = sim_step(&pendulum_system, steps, interval) && record_write(&recorder, &pendulum_system);
+	nsec_t elapsed = get_time() - start;
+	if (!record_close(&recorder) || !ok) {
+		eprintf("Failed to record simulation\n");
+		goto fail;
+	}
+
+	printf("%ld frames of %u pendulums: %.3f s, %.4g frames/s\n",
+	       frames + 1L, pendulum_system.count, elapsed / (double) SEC, (frames + 1.0) / (elapsed / (double) SEC));
+	ret = 0;
+fail:
+	sim_free(&pendulum_system);
+	return ret;
+}
+
+#define SEEK_TIME 5 // seconds the arrow keys seek by during playback
+
+// plays the mapped recording back through the display, at the given speed until a key changes it
+static int run_replay(void) {
+	unsigned count = replay.header->count;
+	pendulum_system.count = count;
+	pendulum_system.gravity = replay.params[0];
+	pendulum_system.chain = NULL; // filled in from the recording every frame
+	if (!sim_state_alloc(&pendulum_system)) return 2;
+
+	if (!start()) return 3;
+
+	char str[1024] = "";
+	const nsec_t wait_time = SEC / (MAX_FPS);
+	double duration = record_duration(&replay), position = 0, speed = 1;
+	bool paused = false;
+	nsec_t last = get_time();
+
+	while (1) {
+		// the display puts the terminal in raw mode, so keys arrive as they're pressed
+		struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+		while (poll(&pfd, 1, 0) > 0) {
+			char keys[16];
+			ssize_t len = read(STDIN_FILENO, keys, sizeof(keys));
+			if (len <= 0) break;
+			for (ssize_t i = 0; i < len; ++i) {
+				if (keys[i] == '\x1b' && i + 2 < len && keys[i + 1] == '[') {
+					switch (keys[i += 2]) {
+						case 'A': speed *= 2; break;
+						case 'B': speed /= 2; break;
+						case 'C': position += SEEK_TIME; break;
+						case 'D': position -= SEEK_TIME; break;
+						case 'H': position = 0; break;
+						case 'F': position = duration; break;
+					}
+					continue;
+				}
+				switch (keys[i]) {
+					case ' ': paused = !paused; break;
+					case 'r': speed = -speed; break;
+					case 'q': return stop() ? 0 : 3;
+				}
+			}
+		}
+
+		nsec_t time = get_time();
+		if (!paused) position += speed * (SIMULATION_SPEED) * ((time - last) / (double) SEC);
+		last = time;
+		position = fmin(fmax(position, 0), duration);
+
+		double ke, gpe;
+		record_sample(&replay, position, &pendulum_system, &ke, &gpe);
+
+		int printf_res = snprintf(str, sizeof(str),
+		                          "        Playback: %10.3f / %.3f s at %gx%s\n"
+		                          "  Kinetic energy: %10.3f J\n"
+		                          "Potential energy: %10.3f J\n"
+		                          "    Total energy: %10.3f J\n",
+		                          position, duration, speed, paused ? " (paused)" : "",
+		                          ke, gpe, ke + gpe);
+		if (printf_res < 0 || printf_res >= sizeof(str)) goto fail;
+
+		if (!display_render(&pendulum_system, str)) goto fail;
+		nsleep(wait_time);
+	}
+
+fail:
+	if (!stop()) return 3;
+	return 1;
+}
+
+// serves the simulation headless, stepping it once for any number of viewers
+static int run_serve(const char *path, unsigned steps) {
+	if (!sim_init(&pendulum_system)) {
+		eprintf("Failed to initialise simulation\n");
+		return 3;
+	}
+
+	eprintf("Serving %u pendulums on %s\n", pendulum_system.count, path);
+	int ret = 0;
+	if (!net_serve(&pendulum_system, path, steps)) {
+		perror(path);
+		ret = 1;
+	}
+	sim_free(&pendulum_system);
+	return ret;
+}
+
+// draws the newest state the server has sent, at the display's own rate
+static int run_view(void) {
+	struct net_hello *hello = remote.hello;
+	pendulum_system.count = hello->count;
+	pendulum_system.gravity = hello->gravity;
+	pendulum_system.chain = NULL;
+	if (!sim_state_alloc(&pendulum_system)) return 2;
+	memcpy(pendulum_system.mass, hello->params, hello->count * 2 * sizeof(*hello->params)); // length follows mass in both
+
+	if (!start()) return 3;
+
+	char str[1024] = "";
+	const nsec_t wait_time = SEC / (MAX_FPS);
+	int ret = 1;
+	while (1) {
+		if (!net_receive(&remote)) {
+			ret = 0;
+			goto fail;
+		}
+
+		struct net_state *state = remote.state;
+		if (state) memcpy(pendulum_system.angle, state->y, pendulum_system.count * 2 * sizeof(*state->y));
+
+		int printf_res = snprintf(str, sizeof(str),
+		                          "     Server time: %10.3f s, tick %" PRIu64 "\n"
+		                          "         Batches: %10lu received, %lu dropped\n"
+		                          "  Kinetic energy: %10.3f J\n"
+		                          "Potential energy: %10.3f J\n"
+		                          "    Total energy: %10.3f J\n",
+		                          state ? state->time : 0, state ? state->tick : 0,
+		                          remote.batches, remote.dropped,
+		                          state ? state->ke : 0, state ? state->gpe : 0, state ? state->ke + state->gpe : 0);
+		if (printf_res < 0 || printf_res >= sizeof(str)) goto fail;
+
+		if (!display_render(&pendulum_system, str)) goto fail;
+		nsleep(wait_time);
+	}
+
+fail:
+	if (!stop()) ret = 3;
+	net_close(&remote);
+	if (!ret) eprintf("The server closed the connection\n");
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	CONFIGURE(pendulum_system);
+
+	unsigned rope_links = 0, steps = STEPS_PER_TICK, sweep_size = 0, threads = 0, time = HEADLESS_TIME;
+	const char *record_path = NULL, *replay_path = NULL, *profile_path = NULL, *serve_path = NULL, *view_path = NULL;
+	bool float32 = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "e:i:r:s:S:j:w:qt:p:P:bm:l:c:h")) != -1) {
+		switch (opt) {
+			case 'e':
+				if (!strcmp(optarg, "symbolic")) pendulum_system.engine = SIM_ENGINE_SYMBOLIC;
+				else if (!strcmp(optarg, "numeric")) pendulum_system.engine = SIM_ENGINE_NUMERIC;
+				else goto usage;
+				break;
+			case 'i':
+				if (!strcmp(optarg, "rk4")) pendulum_system.integrator = SIM_INTEGRATOR_RK4;
+				else if (!strcmp(optarg, "dopri5")) pendulum_system.integrator = SIM_INTEGRATOR_DOPRI5;
+				else if (!strcmp(optarg, "symplectic")) pendulum_system.integrator = SIM_INTEGRATOR_SYMPLECTIC;
+				else if (!strcmp(optarg, "rosenbrock")) pendulum_system.integrator = SIM_INTEGRATOR_ROSENBROCK;
+				else goto usage;
+				break;
+			case 'r':
+				if (!parse_uint(optarg, &rope_links)) goto usage;
+				break;
+			case 's':
+				if (!parse_uint(optarg, &steps)) goto usage;
+				break;
+			case 'S':
+				if (!parse_uint(optarg, &sweep_size)) goto usage;
+				break;
+			case 'j':
+				if (!parse_uint(optarg, &threads)) goto usage;
+				break;
+			case 'w':
+				record_path = optarg;
+				break;
+			case 'q':
+				float32 = true;
+				break;
+			case 't':
+				if (!parse_uint(optarg, &time)) goto usage;
+				break;
+			case 'p':
+				replay_path = optarg;
+				break;
+			case 'P':
+				profile_path = optarg;
+				break;
+			case 'b':
+				display_set_mode(DISPLAY_BRAILLE);
+				break;
+			case 'm':
+				publish_name = optarg;
+				break;
+			case 'l':
+				serve_path = optarg;
+				break;
+			case 'c':
+				view_path = optarg;
+				break;
+			default:
+				goto usage;
+		}
+	}
+	if (optind != argc) goto usage;
+	if (view_path && publish_name) goto usage;
+	if (profile_path && !PROFILE) {
+		eprintf("-P needs PROFILE to be enabled in config.h\n");
+		return 2;
+	}
+
+	if (rope_links) {
+		struct pendulum *rope = make_rope(&pendulum_system, rope_links);
+		if (!rope) return 2;
+		pendulum_system.chain = rope;
+		pendulum_system.count = rope_links;
+	}
+
+	if ((sweep_size != 0) + (record_path != NULL) + (replay_path != NULL) + (serve_path != NULL) + (view_path != NULL) > 1) goto usage;
+	if (sweep_size) return run_sweep(sweep_size, threads, steps, time);
+	if (record_path) return run_record(record_path, float32, steps, time);
+	if (serve_path) return run_serve(serve_path, steps);
+
 	struct sigaction sa;
 	if (sigemptyset(&sa.sa_mask)) return 2;
 	sa.sa_handler = signal_func;
@@ -101,67 +576,94 @@ int main(void) {
 		sigaction(signal, &sa, NULL);
 	}
 
-	CONFIGURE(pendulum_system);
+	if (replay_path) {
+		if (!record_map(&replay, replay_path)) {
+			eprintf("Failed to open recording %s\n", replay_path);
+			return 3;
+		}
+		return run_replay();
+	}
 
+	if (view_path) {
+		if (!net_connect(&remote, view_path)) {
+			eprintf("Failed to connect to %s\n", view_path);
+			return 3;
+		}
+		return run_view();
+	}
+
+	steps_per_tick = steps;
 	if (!start()) return 3;
 
 	char str[1024] = "";
 
 	const nsec_t wait_time = SEC / (MAX_FPS);
 	nsec_t dest = get_time(), dest_last = dest;
-	bool frame_skip = FRAME_SKIP;
-	bool lag = false, first = true;
-	nsec_t last_lag = 0;
+#if PROFILE
+	char prof_str[512] = "";
+	nsec_t last_prof = get_time(), last_dump = last_prof;
+#endif
 
 	while (1) {
 		nsec_t time = get_time();
 
-		if (time > dest) dest = time + wait_time; // if more than one second has elapsed, reset the offset and wait until 1 second has passed since now
-		nsec_t delay = dest - time;               // wait until destination time
+		if (time > dest) dest = time + wait_time;
+		nsec_t delay = dest - time;
 
-		if (dest == time + wait_time || nsleep(delay)) {
+		bool due = dest == time + wait_time || nsleep(delay);
+		PROF_BEGIN(frame);
+		if (atomic_load(&sim_failed)) goto fail;
+		if (due) {
 			nsec_t frame_time = dest - dest_last;
-			double time_advance = (SIMULATION_SPEED) * ((frame_skip ? frame_time : wait_time) / (double) SEC);
-
 			time = get_time();
-			if (!first) {
-				if (!sim_step(&pendulum_system, (STEPS_PER_FRAME), time_advance)) goto fail;
-
-				if (frame_time != wait_time) {
-					lag = true;
-					last_lag = time;
-				}
-			}
-			bool show_lag = lag && time < last_lag + SEC;
 
-			double ke, gpe, total;
-			if (!sim_substitute(&ke, pendulum_system.ke, &pendulum_system)) goto fail;
-			if (!sim_substitute(&gpe, pendulum_system.gpe, &pendulum_system)) goto fail;
-			total = ke + gpe;
+			// draw a tick behind the simulation, between the last two states, so motion stays smooth when the frame rate
+			// doesn't divide the tick rate
+			const struct snapshot *snapshot = snapshot_latest(&snapshots);
+			double alpha = time > snapshot->due ? (time - snapshot->due) / (double) (SEC / (SIMULATION_RATE)) : 0;
+			if (alpha > 1) alpha = 1;
+			for (unsigned i = 0; i < view.count; ++i)
+				view.angle[i] = snapshot->last_angle[i] + (snapshot->angle[i] - snapshot->last_angle[i]) * alpha;
 
-			nsec_t sim_time = get_time() - time;
 			int printf_res = snprintf(str, sizeof(str),
-			                          "             FPS: %10.3f Hz%s%s%s\n"
-			                          " Simulation time: %10" PRIuMAX " ns\n"
+			                          "             FPS: %10.3f Hz\n"
+			                          " Simulation time: %10" PRIu64 " ns%s%s%s\n"
 			                          "  Kinetic energy: %10.3f J\n"
 			                          "Potential energy: %10.3f J\n"
 			                          "    Total energy: %10.3f J\n",
-			                          SEC / (double) frame_time,
-			                          show_lag ? " (" : "",
-			                          show_lag ? (frame_skip ? "frame skipping" : "lagging") : "",
-			                          show_lag ? ")" : "",
-			                          sim_time, ke, gpe, total);
+			                          frame_time ? SEC / (double) frame_time : 0,
+			                          snapshot->step_time,
+			                          snapshot->lagging ? " (" : "",
+			                          snapshot->lagging ? "lagging" : "",
+			                          snapshot->lagging ? ")" : "",
+			                          snapshot->ke, snapshot->gpe, snapshot->ke + snapshot->gpe);
 
 			if (printf_res < 0 || printf_res >= sizeof(str)) goto fail;
+#if PROFILE
+			// percentiles over the last second, so spikes stay visible instead of being averaged into the whole run
+			if (time >= last_prof + SEC) {
+				if (!prof_format(prof_str, sizeof(prof_str))) goto fail;
+				last_prof = time;
+			}
+			if (profile_path && time >= last_dump + (nsec_t) (PROFILE_DUMP_INTERVAL) * SEC) {
+				if (!prof_dump(profile_path)) goto fail;
+				last_dump = time;
+			}
+			if (printf_res + strlen(prof_str) >= sizeof(str)) goto fail;
+			strcat(str, prof_str);
+#endif
 			dest_last = dest;
-			dest += wait_time; // add delay amount to destination time so we can precisely run the code on that interval
-			first = false;
+			dest += wait_time;
 		}
-		if (!display_render(&pendulum_system, str)) goto fail;
+		if (!display_render(&view, str)) goto fail;
+		PROF_END(frame, PROF_FRAME);
 	}
 
 	return 0;
 fail:
 	if (!stop()) return 3;
 	return 1;
+usage:
+	usage(argv[0]);
+	return 2;
 }
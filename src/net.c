@@ -0,0 +1,305 @@
+#define _GNU_SOURCE // accept4
+#include "net.h"
+#include "util.h"
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#define MAX_EVENTS 64
+#define NET_QUEUE 4 // batches the socket buffer of each viewer is sized for
+
+struct viewer {
+	int fd;
+	bool behind;          // waiting for room to send the newest batch
+	unsigned long dropped; // batches missed since the last one sent
+};
+
+struct server {
+	struct pendulum_system *system;
+	int epoll, listen, timer, signal;
+	struct viewer *viewer;
+	unsigned viewers, capacity;
+	struct net_hello *hello;
+	// batches are filled in building, then swapped into ready, which is what gets sent
+	struct net_batch *building, *ready;
+	size_t hello_size, batch_size;
+};
+
+static bool set_address(struct sockaddr_un *address, const char *path) {
+	*address = (struct sockaddr_un) {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof(address->sun_path)) return false;
+	strcpy(address->sun_path, path);
+	return true;
+}
+
+static struct net_state *batch_state(struct net_batch *batch, unsigned count, unsigned i) {
+	return (struct net_state *) ((char *) (batch + 1) + i * NET_STATE_SIZE(count));
+}
+
+static bool watch(struct server *server, int fd, uint32_t events, int op) {
+	struct epoll_event event = {.events = events, .data.fd = fd};
+	return !epoll_ctl(server->epoll, op, fd, &event);
+}
+
+static void drop_viewer(struct server *server, unsigned i) {
+	epoll_ctl(server->epoll, EPOLL_CTL_DEL, server->viewer[i].fd, NULL);
+	close(server->viewer[i].fd);
+	server->viewer[i] = server->viewer[--server->viewers];
+}
+
+static struct viewer *find_viewer(struct server *server, int fd, unsigned *index) {
+	for (unsigned i = 0; i < server->viewers; ++i)
+		if (server->viewer[i].fd == fd) {
+			*index = i;
+			return &server->viewer[i];
+		}
+	return NULL;
+}
+
+// sends the newest batch without blocking, false if the viewer should be dropped
+static bool send_batch(struct server *server, struct viewer *viewer) {
+	server->ready->dropped = viewer->dropped;
+	if (send(viewer->fd, server->ready, server->batch_size, MSG_DONTWAIT | MSG_NOSIGNAL) >= 0) {
+		viewer->dropped = 0;
+		if (viewer->behind && !watch(server, viewer->fd, EPOLLIN, EPOLL_CTL_MOD)) return false;
+		viewer->behind = false;
+		return true;
+	}
+	if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+	// send it when there's room, unless a newer one replaces it first
+	if (!viewer->behind && !watch(server, viewer->fd, EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD)) return false;
+	viewer->behind = true;
+	return true;
+}
+
+static void broadcast(struct server *server) {
+	SWAP(struct net_batch *, server->building, server->ready);
+	server->building->states = 0;
+	for (unsigned i = 0; i < server->viewers;) {
+		struct viewer *viewer = &server->viewer[i];
+		if (viewer->behind) {
+			// still waiting for room, it'll get this batch instead of the one it missed
+			++viewer->dropped;
+			++i;
+		} else if (send_batch(server, viewer)) ++i;
+		else drop_viewer(server, i);
+	}
+}
+
+static bool accept_viewers(struct server *server) {
+	for (;;) {
+		int fd = accept4(server->listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED;
+
+		if (server->viewers == server->capacity) {
+			unsigned capacity = server->capacity ? server->capacity * 2 : 8;
+			struct viewer *viewer = realloc(server->viewer, capacity * sizeof(*viewer));
+			if (!viewer) {
+				close(fd);
+				return false;
+			}
+			server->viewer = viewer;
+			server->capacity = capacity;
+		}
+		// keep only a few batches queued, so a slow viewer gets recent states instead of working through a backlog
+		int buffer = NET_QUEUE * server->batch_size;
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+		// the socket buffer is empty, so the hello always fits
+		if (send(fd, server->hello, server->hello_size, MSG_DONTWAIT | MSG_NOSIGNAL) < 0 || !watch(server, fd, EPOLLIN, EPOLL_CTL_ADD)) {
+			close(fd);
+			continue;
+		}
+		server->viewer[server->viewers++] = (struct viewer) {.fd = fd};
+	}
+}
+
+// runs the ticks that are due, with the same fixed step as the display, adding each state to the batch being built
+static bool tick(struct server *server, uint64_t expirations, unsigned steps, uint64_t *ticks) {
+	struct pendulum_system *system = server->system;
+	const double dt = (SIMULATION_SPEED) / (double) (SIMULATION_RATE);
+	if (expirations > (MAX_CATCH_UP)) expirations = MAX_CATCH_UP; // fall behind rather than spiral
+
+	for (uint64_t i = 0; i < expirations; ++i) {
+		if (!sim_step(system, steps, dt)) return false;
+		++*ticks;
+
+		struct net_state *state = batch_state(server->building, system->count, server->building->states++);
+		state->tick = *ticks;
+		state->time = *ticks * dt;
+		if (!sim_energy(system, &state->ke, &state->gpe)) return false;
+		memcpy(state->y, system->angle, system->count * 2 * sizeof(*state->y)); // angvel follows angle
+
+		if (server->building->states == NET_BATCH) broadcast(server);
+	}
+	return true;
+}
+
+// the signals dpend otherwise stops on, like the display does, except faults, which can't be put off until the next event
+static void terminating_signals(sigset_t *signals) {
+	sigemptyset(signals);
+	for (int signal = 1; signal < NSIG; ++signal) {
+		if (signal == SIGCHLD || signal == SIGURG || signal == SIGWINCH || signal == SIGCONT) continue; // ignored by default
+		if (signal == SIGTSTP || signal == SIGTTIN || signal == SIGTTOU) continue; // job control, the server can just stop
+		if (signal == SIGKILL || signal == SIGSTOP) continue; // can't handle these
+		if (signal == SIGSEGV || signal == SIGBUS || signal == SIGFPE || signal == SIGILL || signal == SIGTRAP ||
+		    signal == SIGABRT || signal == SIGSYS)
+			continue;
+		sigaddset(signals, signal);
+	}
+}
+
+bool net_serve(struct pendulum_system *system, const char *path, unsigned steps) {
+	unsigned count = system->count;
+	struct server server = {
+	        .system = system,
+	        .epoll = -1,
+	        .listen = -1,
+	        .timer = -1,
+	        .signal = -1,
+	        .hello_size = NET_HELLO_SIZE(count),
+	        .batch_size = NET_BATCH_SIZE(count),
+	};
+	bool ret = false, bound = false;
+
+	server.hello = calloc(1, server.hello_size);
+	server.building = calloc(1, server.batch_size);
+	server.ready = calloc(1, server.batch_size);
+	if (!server.hello || !server.building || !server.ready) goto fail;
+
+	memcpy(server.hello->magic, NET_MAGIC, sizeof(server.hello->magic));
+	server.hello->version = NET_VERSION;
+	server.hello->count = count;
+	server.hello->gravity = system->gravity;
+	server.hello->interval = (SIMULATION_SPEED) / (double) (SIMULATION_RATE);
+	memcpy(server.hello->params, system->mass, count * 2 * sizeof(*server.hello->params)); // length follows mass
+
+	struct sockaddr_un address;
+	if (!set_address(&address, path)) goto fail;
+	server.listen = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (server.listen < 0) goto fail;
+	unlink(path); // left behind by a server that didn't exit cleanly
+	if (bind(server.listen, (struct sockaddr *) &address, sizeof(address))) goto fail;
+	bound = true;
+	if (listen(server.listen, SOMAXCONN)) goto fail;
+
+	// stop on these between events instead of in a handler, so the socket is removed
+	sigset_t signals;
+	terminating_signals(&signals);
+	if (sigprocmask(SIG_BLOCK, &signals, NULL)) goto fail;
+	server.signal = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	const long tick_ns = 1000000000 / (SIMULATION_RATE);
+	struct timespec period = {.tv_sec = tick_ns / 1000000000, .tv_nsec = tick_ns % 1000000000};
+	struct itimerspec interval = {.it_interval = period, .it_value = period};
+	server.timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (server.timer < 0 || timerfd_settime(server.timer, 0, &interval, NULL)) goto fail;
+
+	server.epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (server.epoll < 0 || server.signal < 0) goto fail;
+	if (!watch(&server, server.listen, EPOLLIN, EPOLL_CTL_ADD) || !watch(&server, server.timer, EPOLLIN, EPOLL_CTL_ADD) ||
+	    !watch(&server, server.signal, EPOLLIN, EPOLL_CTL_ADD))
+		goto fail;
+
+	uint64_t ticks = 0;
+	struct epoll_event events[MAX_EVENTS];
+	for (;;) {
+		int ready = epoll_wait(server.epoll, events, MAX_EVENTS, -1);
+		if (ready < 0) {
+			if (errno == EINTR) continue;
+			goto fail;
+		}
+		for (int i = 0; i < ready; ++i) {
+			int fd = events[i].data.fd;
+			if (fd == server.signal) {
+				ret = true;
+				goto fail;
+			} else if (fd == server.listen) {
+				if (!accept_viewers(&server)) goto fail;
+			} else if (fd == server.timer) {
+				uint64_t expirations;
+				if (read(server.timer, &expirations, sizeof(expirations)) == sizeof(expirations) && !tick(&server, expirations, steps, &ticks))
+					goto fail;
+			} else {
+				unsigned index;
+				struct viewer *viewer = find_viewer(&server, fd, &index);
+				if (!viewer) continue;
+				bool ok = !(events[i].events & (EPOLLERR | EPOLLHUP));
+				if (ok && events[i].events & EPOLLIN) {
+					// viewers have nothing to say, so anything readable means they hung up
+					char discard[64];
+					ssize_t len = recv(fd, discard, sizeof(discard), MSG_DONTWAIT);
+					ok = len > 0 || (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+				}
+				if (ok && events[i].events & EPOLLOUT && viewer->behind) ok = send_batch(&server, viewer);
+				if (!ok) drop_viewer(&server, index);
+			}
+		}
+	}
+
+fail:
+	while (server.viewers) drop_viewer(&server, 0);
+	if (server.epoll >= 0) close(server.epoll);
+	if (server.timer >= 0) close(server.timer);
+	if (server.signal >= 0) close(server.signal);
+	if (server.listen >= 0) close(server.listen);
+	if (bound) unlink(path);
+	free(server.viewer);
+	free(server.hello);
+	free(server.building);
+	free(server.ready);
+	return ret;
+}
+
+bool net_connect(struct net_client *client, const char *path) {
+	*client = (struct net_client) {.fd = -1};
+	struct sockaddr_un address;
+	if (!set_address(&address, path)) return false;
+	client->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (client->fd < 0) return false;
+	if (connect(client->fd, (struct sockaddr *) &address, sizeof(address))) goto fail;
+
+	// the hello is the first message, its size depends on the pendulum count so peek at the fixed part first
+	struct net_hello hello;
+	if (recv(client->fd, &hello, sizeof(hello), MSG_PEEK) != sizeof(hello)) goto fail;
+	if (memcmp(hello.magic, NET_MAGIC, sizeof(hello.magic)) || hello.version != NET_VERSION) goto fail;
+	client->hello = malloc(NET_HELLO_SIZE(hello.count));
+	client->message = malloc(NET_BATCH_SIZE(hello.count));
+	if (!client->hello || !client->message) goto fail;
+	if (recv(client->fd, client->hello, NET_HELLO_SIZE(hello.count), 0) != NET_HELLO_SIZE(hello.count)) goto fail;
+	return true;
+fail:
+	net_close(client);
+	return false;
+}
+
+bool net_receive(struct net_client *client) {
+	unsigned count = client->hello->count;
+	for (;;) {
+		ssize_t len = recv(client->fd, client->message, NET_BATCH_SIZE(count), MSG_DONTWAIT);
+		if (len < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		if (len == 0) return false;
+		struct net_batch *batch = (struct net_batch *) client->message;
+		if (len < sizeof(*batch) || !batch->states || batch->states > NET_BATCH || len != sizeof(*batch) + batch->states * NET_STATE_SIZE(count))
+			return false;
+		++client->batches;
+		client->dropped += batch->dropped;
+		client->state = batch_state(batch, count, batch->states - 1);
+	}
+}
+
+void net_close(struct net_client *client) {
+	if (client->fd >= 0) close(client->fd);
+	client->fd = -1;
+	FREE(client->hello);
+	FREE(client->message);
+	client->state = NULL;
+}
@@ -0,0 +1,55 @@
+#ifndef NET_H
+#define NET_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sim.h"
+
+// serves the simulation to any number of viewers over a unix domain socket (SOCK_SEQPACKET, so messages keep their boundaries)
+// the server sends a hello, then a batch of NET_BATCH states every NET_BATCH ticks
+// a viewer that can't keep up isn't waited for: its batches collapse into the newest one, which it's sent once it can take it
+// numbers are in native byte order, since both ends are on the same machine
+
+#define NET_MAGIC "DPENDNET"
+#define NET_VERSION 2
+#define NET_BATCH 4 // ticks per message
+
+struct net_hello {
+	char magic[8];
+	uint32_t version, count;
+	double gravity;
+	double interval; // simulated seconds per tick
+	double params[]; // mass of each pendulum, then the length of each
+};
+
+struct net_state {
+	uint64_t tick;
+	double time, ke, gpe;
+	double y[]; // angle of each pendulum, then the angular velocity of each
+};
+
+struct net_batch {
+	uint32_t states;
+	uint32_t dropped; // batches this viewer missed before this one
+	// followed by the states
+};
+
+#define NET_HELLO_SIZE(count) (sizeof(struct net_hello) + (count) * 2 * sizeof(double))
+#define NET_STATE_SIZE(count) (sizeof(struct net_state) + (count) * 2 * sizeof(double))
+#define NET_BATCH_SIZE(count) (sizeof(struct net_batch) + NET_BATCH * NET_STATE_SIZE(count))
+
+// steps the simulation at SIMULATION_RATE and serves it on path until SIGINT or SIGTERM
+bool net_serve(struct pendulum_system *system, const char *path, unsigned steps);
+
+struct net_client {
+	int fd;
+	struct net_hello *hello;
+	char *message;         // the last batch received
+	struct net_state *state; // latest state in it, NULL until one arrives
+	unsigned long batches, dropped;
+};
+
+bool net_connect(struct net_client *client, const char *path);
+bool net_receive(struct net_client *client); // takes every message waiting without blocking, false once the server is gone
+void net_close(struct net_client *client);
+#endif
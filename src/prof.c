@@ -0,0 +1,81 @@
+#include "prof.h"
+
+#if PROFILE
+#include <stdio.h>
+#include <limits.h>
+#include <inttypes.h>
+
+struct prof_histogram prof_total[PROF_PHASES], prof_window[PROF_PHASES];
+
+static const char *phase_name[PROF_PHASES] = {
+        [PROF_FRAME] = "frame",
+        [PROF_STEP] = "step",
+        [PROF_ENERGY] = "energy",
+        [PROF_RASTER] = "raster",
+        [PROF_WRITE] = "write",
+};
+
+// the largest value that falls in the bucket
+static uint64_t bucket_max(unsigned bucket) {
+	if (bucket < 1 << PROF_SUB_BITS) return bucket;
+	unsigned shift = (bucket >> PROF_SUB_BITS) - 1;
+	uint64_t lower = (uint64_t) ((1 << PROF_SUB_BITS) + (bucket & ((1 << PROF_SUB_BITS) - 1))) << shift;
+	return lower + ((uint64_t) 1 << shift) - 1;
+}
+
+uint64_t prof_percentile(const struct prof_histogram *histogram, double percentile) {
+	if (!histogram->count) return 0;
+	uint64_t target = histogram->count * percentile / 100, seen = 0;
+	for (unsigned i = 0; i < PROF_BUCKETS; ++i) {
+		seen += histogram->bucket[i];
+		if (seen > target) {
+			uint64_t max = bucket_max(i);
+			return max < histogram->max ? max : histogram->max;
+		}
+	}
+	return histogram->max;
+}
+
+static void prof_reset(struct prof_histogram *histogram) {
+	atomic_store_explicit(&histogram->count, 0, memory_order_relaxed);
+	atomic_store_explicit(&histogram->max, 0, memory_order_relaxed);
+	for (unsigned i = 0; i < PROF_BUCKETS; ++i) atomic_store_explicit(&histogram->bucket[i], 0, memory_order_relaxed);
+}
+
+bool prof_format(char *str, size_t size) {
+	for (unsigned i = 0; i < PROF_PHASES; ++i) {
+		struct prof_histogram *h = &prof_window[i];
+		int printf_res = snprintf(str, size, "%16s: %10.3f us p50 %10.3f us p99 %10.3f us max\n", phase_name[i],
+		                          prof_percentile(h, 50) / 1e3, prof_percentile(h, 99) / 1e3, h->max / 1e3);
+		if (printf_res < 0 || printf_res >= size) return false;
+		str += printf_res, size -= printf_res;
+	}
+	for (unsigned i = 0; i < PROF_PHASES; ++i) prof_reset(&prof_window[i]);
+	return true;
+}
+
+bool prof_dump(const char *path) {
+	char temp_path[PATH_MAX];
+	int printf_res = snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+	if (printf_res < 0 || printf_res >= sizeof(temp_path)) return false;
+
+	FILE *file = fopen(temp_path, "w");
+	if (!file) return false;
+
+	// a summary line for each phase, then the upper bound and count of each bucket that was hit
+	for (unsigned i = 0; i < PROF_PHASES; ++i) {
+		struct prof_histogram *h = &prof_total[i];
+		fprintf(file, "%s count %" PRIu64 " p50 %" PRIu64 " p90 %" PRIu64 " p99 %" PRIu64 " p99.9 %" PRIu64 " max %" PRIu64 "\n",
+		        phase_name[i], h->count, prof_percentile(h, 50), prof_percentile(h, 90), prof_percentile(h, 99), prof_percentile(h, 99.9), h->max);
+	}
+	for (unsigned i = 0; i < PROF_PHASES; ++i)
+		for (unsigned j = 0; j < PROF_BUCKETS; ++j)
+			if (prof_total[i].bucket[j]) fprintf(file, "%s %" PRIu64 " %" PRIu32 "\n", phase_name[i], bucket_max(j), prof_total[i].bucket[j]);
+
+	bool ok = !ferror(file);
+	if (fclose(file)) ok = false;
+	if (ok && rename(temp_path, path)) ok = false;
+	if (!ok) remove(temp_path);
+	return ok;
+}
+#endif
@@ -0,0 +1,74 @@
+#ifndef PROF_H
+#define PROF_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "config.h"
+
+// timers around each phase of a frame, recorded into log-linear histograms (like HdrHistogram) with 1/16 resolution
+// with PROFILE disabled the timers compile to nothing
+
+enum prof_phase {
+	PROF_FRAME,  // everything from stepping the simulation to the end of rendering
+	PROF_STEP,   // sim_step
+	PROF_ENERGY, // sim_energy
+	PROF_RASTER, // drawing the chain into the screen buffer
+	PROF_WRITE,  // writing to the terminal
+	PROF_PHASES,
+};
+
+#if PROFILE
+#define PROF_SUB_BITS 4
+#define PROF_BUCKETS ((64 - PROF_SUB_BITS + 1) << PROF_SUB_BITS)
+
+// relaxed atomics, since the display thread reads and resets the phases the simulation thread records
+struct prof_histogram {
+	_Atomic uint64_t count, max;
+	_Atomic uint32_t bucket[PROF_BUCKETS];
+};
+
+// everything since startup, and since the overlay was last refreshed
+// each phase is only recorded by one thread, and reads aren't ordered with its writes, which at worst misplaces a sample at
+// the edge of a window
+extern struct prof_histogram prof_total[PROF_PHASES], prof_window[PROF_PHASES];
+
+static inline uint64_t prof_now(void) {
+	struct timespec tp;
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return (uint64_t) tp.tv_sec * 1000000000 + tp.tv_nsec;
+}
+
+static inline unsigned prof_bucket(uint64_t ns) {
+	if (ns < 1 << PROF_SUB_BITS) return ns;
+	unsigned shift = 63 - __builtin_clzll(ns) - PROF_SUB_BITS;
+	return ((shift + 1) << PROF_SUB_BITS) + ((ns >> shift) & ((1 << PROF_SUB_BITS) - 1));
+}
+
+static inline void prof_add(struct prof_histogram *histogram, uint64_t ns) {
+	atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&histogram->bucket[prof_bucket(ns)], 1, memory_order_relaxed);
+	// only the recording thread raises the maximum
+	if (ns > atomic_load_explicit(&histogram->max, memory_order_relaxed))
+		atomic_store_explicit(&histogram->max, ns, memory_order_relaxed);
+}
+
+static inline void prof_record(enum prof_phase phase, uint64_t ns) {
+	prof_add(&prof_total[phase], ns);
+	prof_add(&prof_window[phase], ns);
+}
+
+#define PROF_BEGIN(name) uint64_t prof_start_##name = prof_now()
+#define PROF_END(name, phase) prof_record(phase, prof_now() - prof_start_##name)
+
+uint64_t prof_percentile(const struct prof_histogram *histogram, double percentile);
+// writes p50/p99/max of each phase since the last call, one line each, and starts a new window
+bool prof_format(char *str, size_t size);
+bool prof_dump(const char *path); // every bucket of the totals, replacing the file atomically
+#else
+#define PROF_BEGIN(name)
+#define PROF_END(name, phase)
+#endif
+#endif
@@ -0,0 +1,84 @@
+#include "publish.h"
+#include "sim.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+bool publish_open(struct publisher *publisher, const char *name, const struct pendulum_system *system) {
+	*publisher = (struct publisher) {0};
+	int printf_res = snprintf(publisher->name, sizeof(publisher->name), "/%s", name);
+	if (printf_res < 0 || printf_res >= sizeof(publisher->name)) return false;
+
+	// fill the region in under a temporary name and rename it over the real one, so readers never open it before it has its
+	// size, and any region left behind is replaced rather than resized under readers that still have it mapped
+	// POSIX can't rename shared memory objects, but on Linux they are files in /dev/shm
+	char temp_name[sizeof(publisher->name) + 16], path[sizeof(publisher->name) + 16], temp_path[sizeof(temp_name) + 16];
+	printf_res = snprintf(temp_name, sizeof(temp_name), "%s.%ld", publisher->name, (long) getpid());
+	if (printf_res < 0 || printf_res >= sizeof(temp_name)) return false;
+	snprintf(path, sizeof(path), "/dev/shm%s", publisher->name);
+	snprintf(temp_path, sizeof(temp_path), "/dev/shm%s", temp_name);
+
+	size_t size = PUBLISH_SIZE(system->count);
+	int fd = shm_open(temp_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) return false;
+	bool ok = !ftruncate(fd, size);
+	void *map = ok ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (map == MAP_FAILED) {
+		shm_unlink(temp_name);
+		return false;
+	}
+
+	struct publish_region *region = map;
+	memcpy(region->magic, PUBLISH_MAGIC, sizeof(region->magic));
+	region->version = PUBLISH_VERSION;
+	region->count = system->count;
+	region->size = size;
+	region->gravity = system->gravity;
+	atomic_init(&region->sequence, 0);
+	for (unsigned i = 0; i < system->count; ++i) {
+		region->pendulum[i].mass = system->mass[i];
+		region->pendulum[i].length = system->length[i];
+	}
+	publisher->region = region;
+	publish_update(publisher, system, 0, 0, 0, 0, 0);
+
+	if (rename(temp_path, path)) {
+		munmap(region, size);
+		shm_unlink(temp_name);
+		publisher->region = NULL;
+		return false;
+	}
+	return true;
+}
+
+void publish_update(struct publisher *publisher, const struct pendulum_system *system, uint64_t ticks, uint64_t steps, double time,
+                    double ke, double gpe) {
+	struct publish_region *region = publisher->region;
+	uint64_t sequence = atomic_load_explicit(&region->sequence, memory_order_relaxed);
+	atomic_store_explicit(&region->sequence, sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release); // the odd sequence is visible before any of the new state
+
+	region->ticks = ticks;
+	region->steps = steps;
+	region->evaluations = system->evaluations;
+	region->time = time;
+	region->ke = ke;
+	region->gpe = gpe;
+	for (unsigned i = 0; i < region->count; ++i) {
+		region->pendulum[i].angle = system->angle[i];
+		region->pendulum[i].angvel = system->angvel[i];
+	}
+	region->checksum = publish_checksum(region, region->pendulum, region->count);
+
+	atomic_store_explicit(&region->sequence, sequence + 2, memory_order_release);
+}
+
+void publish_close(struct publisher *publisher) {
+	if (!publisher->region) return;
+	munmap(publisher->region, publisher->region->size);
+	shm_unlink(publisher->name);
+	publisher->region = NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef PUBLISH_H
+#define PUBLISH_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// the live state of the simulation in shared memory (/dev/shm/<name>), for other processes on the machine to poll without
+// syscalls or slowing the simulation down
+// updates are guarded by a seqlock: sequence is odd while one is being written, so a reader copies what it needs between two
+// reads of an even and unchanged sequence, retrying otherwise, see reader.c
+// numbers are in native byte order
+
+#define PUBLISH_MAGIC "DPENDSHM"
+#define PUBLISH_VERSION 1
+
+struct publish_pendulum {
+	double mass, length, angle, angvel;
+};
+
+struct publish_region {
+	char magic[8];
+	uint32_t version;
+	uint32_t count; // pendulums
+	uint64_t size;  // bytes of the region
+	double gravity;
+	_Alignas(64) _Atomic uint64_t sequence;
+	uint64_t ticks, steps, evaluations; // simulation ticks, integration steps and evaluations of the equations of motion
+	double time;                        // simulated seconds
+	double ke, gpe;
+	uint64_t checksum; // of the fields above after sequence and the pendulums, see publish_checksum
+	struct publish_pendulum pendulum[];
+};
+
+#define PUBLISH_SIZE(count) (sizeof(struct publish_region) + (count) * sizeof(struct publish_pendulum))
+
+// FNV-1a over the bytes of the state, so readers can check they never see a torn update
+static inline uint64_t publish_checksum(const struct publish_region *region, const struct publish_pendulum *pendulum, unsigned count) {
+	uint64_t hash = 0xcbf29ce484222325;
+	const unsigned char *bytes = (const unsigned char *) &region->ticks;
+	for (size_t i = 0; i < offsetof(struct publish_region, checksum) - offsetof(struct publish_region, ticks); ++i)
+		hash = (hash ^ bytes[i]) * 0x100000001b3;
+	bytes = (const unsigned char *) pendulum;
+	for (size_t i = 0; i < count * sizeof(*pendulum); ++i) hash = (hash ^ bytes[i]) * 0x100000001b3;
+	return hash;
+}
+
+struct pendulum_system;
+
+struct publisher {
+	char name[256];
+	struct publish_region *region;
+};
+
+bool publish_open(struct publisher *publisher, const char *name, const struct pendulum_system *system);
+void publish_update(struct publisher *publisher, const struct pendulum_system *system, uint64_t ticks, uint64_t steps, double time,
+                    double ke, double gpe);
+void publish_close(struct publisher *publisher); // and remove it, so readers can tell the simulation is gone from the name
+#endif
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "publish.h"
+#include "sim.h"
+
+// example reader of the state dpend -m publishes, printing it a few times a second
+// with -c it instead reads as fast as it can for a while and checks every read against its checksum, to catch torn reads
+// with -s it does the same against a child process of its own that publishes updates back to back, to stress the seqlock
+
+#define eprintf(...) fprintf(stderr, __VA_ARGS__)
+
+#define PRINT_INTERVAL 100000 // microseconds between printed states
+#define STRESS_COUNT 64       // pendulums published by the -s writer, so each update takes a while to copy
+
+static double now(void) {
+	struct timespec tp;
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return tp.tv_sec + tp.tv_nsec / 1e9;
+}
+
+static const struct publish_region *map_region(const char *name) {
+	char path[256];
+	int printf_res = snprintf(path, sizeof(path), "/%s", name);
+	if (printf_res < 0 || printf_res >= sizeof(path)) return NULL;
+	int fd = shm_open(path, O_RDONLY, 0);
+	if (fd < 0) return NULL;
+
+	// map the header to find the size, then all of it
+	const struct publish_region *region = mmap(NULL, sizeof(*region), PROT_READ, MAP_SHARED, fd, 0);
+	if (region == MAP_FAILED) goto fail;
+	if (memcmp(region->magic, PUBLISH_MAGIC, sizeof(region->magic)) || region->version != PUBLISH_VERSION) {
+		munmap((void *) region, sizeof(*region));
+		goto fail;
+	}
+	size_t size = region->size;
+	munmap((void *) region, sizeof(*region));
+	region = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	return region == MAP_FAILED ? NULL : region;
+fail:
+	close(fd);
+	return NULL;
+}
+
+// copies an update that wasn't being written at the time, returning how many times it had to retry
+static unsigned long read_state(const struct publish_region *region, struct publish_region *state, struct publish_pendulum *pendulum) {
+	const size_t from = offsetof(struct publish_region, ticks), to = offsetof(struct publish_region, pendulum);
+	for (unsigned long retries = 0;; ++retries) {
+		uint64_t sequence = atomic_load_explicit(&region->sequence, memory_order_acquire);
+		if (sequence & 1) continue;
+		memcpy((char *) state + from, (const char *) region + from, to - from);
+		memcpy(pendulum, region->pendulum, region->count * sizeof(*pendulum));
+		atomic_thread_fence(memory_order_acquire); // the copies complete before the sequence is checked again
+		if (atomic_load_explicit(&region->sequence, memory_order_relaxed) == sequence) return retries;
+	}
+}
+
+// reads for seconds, returning how many reads were torn
+static unsigned long check(const struct publish_region *region, double seconds, struct publish_region *state,
+                           struct publish_pendulum *pendulum) {
+	unsigned long reads = 0, retries = 0, torn = 0, updates = 0;
+	uint64_t last_ticks = 0;
+	for (double start = now(); now() - start < seconds;) {
+		for (unsigned i = 0; i < 1024; ++i, ++reads) {
+			retries += read_state(region, state, pendulum);
+			if (state->checksum != publish_checksum(state, pendulum, region->count)) ++torn;
+			if (state->ticks != last_ticks) ++updates, last_ticks = state->ticks;
+		}
+	}
+	printf("%lu reads, %lu updates seen, %lu retries, %lu torn\n", reads, updates, retries, torn);
+	return torn;
+}
+
+// publishes a made up chain under name from a child process, which updates it as fast as it can until killed
+static pid_t start_writer(const char *name, struct publisher *publisher) {
+	static double state[STRESS_COUNT * 4];
+	struct pendulum_system system = {
+	        .gravity = 9.81,
+	        .count = STRESS_COUNT,
+	        .mass = state,
+	        .length = state + STRESS_COUNT,
+	        .angle = state + STRESS_COUNT * 2,
+	        .angvel = state + STRESS_COUNT * 3,
+	};
+	for (unsigned i = 0; i < STRESS_COUNT; ++i) system.mass[i] = system.length[i] = 1;
+	if (!publish_open(publisher, name, &system)) return -1;
+
+	pid_t parent = getpid(), pid = fork();
+	if (pid < 0) publish_close(publisher);
+	if (pid) return pid;
+	for (uint64_t tick = 1;; ++tick) {
+		// every field changes with every update, so a torn read can't match the checksum by chance
+		for (unsigned i = 0; i < STRESS_COUNT; ++i) {
+			system.angle[i] = tick + i;
+			system.angvel[i] = -(double) tick - i;
+		}
+		system.evaluations = tick;
+		publish_update(publisher, &system, tick, tick, tick / 1e3, tick, -(double) tick);
+		if (!(tick & 0xffff) && getppid() != parent) _exit(0); // don't outlive the reader
+	}
+}
+
+static int stress(const char *name, double seconds) {
+	struct publisher publisher;
+	pid_t writer = start_writer(name, &publisher);
+	if (writer < 0) {
+		eprintf("Failed to publish to /dev/shm/%s\n", name);
+		return 3;
+	}
+
+	int ret = 3;
+	const struct publish_region *region = map_region(name);
+	struct publish_region *state = malloc(sizeof(*state));
+	struct publish_pendulum *pendulum = calloc(STRESS_COUNT, sizeof(*pendulum));
+	if (!region) eprintf("Failed to open /dev/shm/%s\n", name);
+	else if (state && pendulum) ret = check(region, seconds, state, pendulum) ? 1 : 0;
+
+	kill(writer, SIGKILL);
+	waitpid(writer, NULL, 0);
+	publish_close(&publisher);
+	free(state);
+	free(pendulum);
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	double check_time = 0, stress_time = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "c:s:h")) != -1) {
+		switch (opt) {
+			case 'c':
+				check_time = atof(optarg);
+				if (check_time <= 0) goto usage;
+				break;
+			case 's':
+				stress_time = atof(optarg);
+				if (stress_time <= 0) goto usage;
+				break;
+			default:
+				goto usage;
+		}
+	}
+	if (optind + 1 != argc || (check_time && stress_time)) goto usage;
+	if (stress_time) return stress(argv[optind], stress_time);
+
+	const struct publish_region *region = map_region(argv[optind]);
+	if (!region) {
+		eprintf("Failed to open /dev/shm/%s, is dpend running with -m %s?\n", argv[optind], argv[optind]);
+		return 3;
+	}
+
+	unsigned count = region->count;
+	struct publish_region *state = malloc(sizeof(*state));
+	struct publish_pendulum *pendulum = calloc(count, sizeof(*pendulum));
+	if (!state || !pendulum) return 2;
+
+	if (check_time) return check(region, check_time, state, pendulum) ? 1 : 0;
+
+	for (;;) {
+		read_state(region, state, pendulum);
+		printf("t %.3f s, ticks %" PRIu64 ", steps %" PRIu64 ", evaluations %" PRIu64 ", energy %.6f J (%.6f kinetic, %.6f potential)\n",
+		       state->time, state->ticks, state->steps, state->evaluations, state->ke + state->gpe, state->ke, state->gpe);
+		for (unsigned i = 0; i < count; ++i) printf("  %u: angle %10.6f rad, angular velocity %10.6f rad/s\n", i, pendulum[i].angle, pendulum[i].angvel);
+		fflush(stdout);
+		usleep(PRINT_INTERVAL);
+	}
+
+usage:
+	eprintf("usage: %s [-c seconds | -s seconds] name\n"
+	        "  print the state published by dpend -m name\n"
+	        "  -c  instead read as fast as possible for this long, and fail if any read was torn\n"
+	        "  -s  the same, publishing to name from a child process that updates it as fast as it can\n",
+	        argv[0]);
+	return 2;
+}
@@ -0,0 +1,192 @@
+#include "record.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BUFFER_SIZE (RECORD_ALIGN * 256)
+
+static bool write_all(int fd, const void *data, size_t size, off_t offset) {
+	for (const char *p = data; size;) {
+		ssize_t res = pwrite(fd, p, size, offset);
+		if (res < 0) return false;
+		p += res, size -= res, offset += res;
+	}
+	return true;
+}
+
+static bool flush(struct recorder *recorder) {
+	bool ok = write_all(recorder->fd, recorder->buffer, recorder->used, recorder->header.data_offset + recorder->written);
+	recorder->written += recorder->used;
+	recorder->used = 0;
+	return ok;
+}
+
+// records are split across writes where needed, so every write but the last is a whole buffer
+static bool append(struct recorder *recorder, const void *data, size_t size) {
+	for (const char *p = data; size;) {
+		size_t len = BUFFER_SIZE - recorder->used;
+		if (len > size) len = size;
+		memcpy(recorder->buffer + recorder->used, p, len);
+		recorder->used += len, p += len, size -= len;
+		if (recorder->used == BUFFER_SIZE && !flush(recorder)) return false;
+	}
+	return true;
+}
+
+static void free_recorder(struct recorder *recorder) {
+	FREE(recorder->buffer);
+	FREE(recorder->fields);
+	FREE(recorder->fields32);
+	if (recorder->fd >= 0) close(recorder->fd);
+	recorder->fd = -1;
+}
+
+bool record_open(struct recorder *recorder, const char *path, struct pendulum_system *system, double interval, bool float32) {
+	unsigned count = system->count;
+	*recorder = (struct recorder) {
+	        .fd = -1,
+	        .header = {
+	                .version = RECORD_VERSION,
+	                .flags = float32 ? RECORD_FLOAT32 : 0,
+	                .count = count,
+	                .record_size = RECORD_FIELDS(count) * (float32 ? sizeof(float) : sizeof(double)),
+	                .interval = interval,
+	        },
+	};
+	memcpy(recorder->header.magic, RECORD_MAGIC, sizeof(recorder->header.magic));
+
+	size_t params = (1 + count * 2) * sizeof(double);
+	recorder->header.data_offset = (sizeof(recorder->header) + params + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN;
+
+	char *page = calloc(recorder->header.data_offset, 1);
+	recorder->buffer = aligned_alloc(RECORD_ALIGN, BUFFER_SIZE);
+	recorder->fields = calloc(RECORD_FIELDS(count), sizeof(*recorder->fields));
+	recorder->fields32 = calloc(RECORD_FIELDS(count), sizeof(*recorder->fields32));
+	if (!page || !recorder->buffer || !recorder->fields || !recorder->fields32) goto fail;
+
+	memcpy(page, &recorder->header, sizeof(recorder->header));
+	double *param = (double *) (page + sizeof(recorder->header));
+	*param++ = system->gravity;
+	for (unsigned i = 0; i < count; ++i) {
+		*param++ = system->mass[i];
+		*param++ = system->length[i];
+	}
+
+	recorder->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (recorder->fd < 0) goto fail;
+	if (!write_all(recorder->fd, page, recorder->header.data_offset, 0)) goto fail;
+
+	free(page);
+	return true;
+
+fail:
+	free(page);
+	free_recorder(recorder);
+	return false;
+}
+
+bool record_write(struct recorder *recorder, struct pendulum_system *system) {
+	double *field = recorder->fields;
+	if (!sim_energy(system, &field[0], &field[1])) return false;
+	for (unsigned i = 0; i < system->count; ++i) {
+		field[2 + i * 2] = system->angle[i];
+		field[3 + i * 2] = system->angvel[i];
+	}
+
+	bool ok;
+	if (recorder->header.flags & RECORD_FLOAT32) {
+		for (unsigned i = 0; i < RECORD_FIELDS(system->count); ++i) recorder->fields32[i] = field[i];
+		ok = append(recorder, recorder->fields32, recorder->header.record_size);
+	} else {
+		ok = append(recorder, field, recorder->header.record_size);
+	}
+	if (ok) ++recorder->header.records;
+	return ok;
+}
+
+bool record_close(struct recorder *recorder) {
+	bool ok = recorder->fd >= 0;
+	if (ok && recorder->used) ok = flush(recorder);
+	// the record count marks the file as complete, so write it last
+	if (ok) ok = write_all(recorder->fd, &recorder->header, sizeof(recorder->header), 0);
+	if (ok) ok = !fsync(recorder->fd);
+	free_recorder(recorder);
+	return ok;
+}
+
+bool record_map(struct recording *recording, const char *path) {
+	*recording = (struct recording) {0};
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (!fstat(fd, &st) && st.st_size >= (off_t) sizeof(struct record_header)) map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); // the mapping keeps the file open
+	if (map == MAP_FAILED) return false;
+
+	recording->header = map;
+	recording->size = st.st_size;
+	const struct record_header *header = recording->header;
+	if (memcmp(header->magic, RECORD_MAGIC, sizeof(header->magic)) || header->version != RECORD_VERSION) goto fail;
+	// sizes in 64 bits, so a corrupt count can't wrap them into passing, and the parameters and a record must fit in the file
+	uint64_t count = header->count, field_size = header->flags & RECORD_FLOAT32 ? sizeof(float) : sizeof(double);
+	if (count == 0 || header->record_size != RECORD_FIELDS(count) * field_size) goto fail;
+	if (header->data_offset < sizeof(*header) + (1 + count * 2) * sizeof(double) || header->data_offset > recording->size) goto fail;
+	if (recording->size - header->data_offset < header->record_size) goto fail;
+	if (!(header->interval > 0)) goto fail;
+
+	recording->params = (const double *) (header + 1);
+	recording->data = (const char *) map + header->data_offset;
+	recording->records = (recording->size - header->data_offset) / header->record_size;
+	if (header->records && header->records < recording->records) recording->records = header->records;
+	if (recording->records == 0) goto fail;
+
+	// playback mostly moves forwards
+	madvise(map, recording->size, MADV_SEQUENTIAL);
+	return true;
+
+fail:
+	record_unmap(recording);
+	return false;
+}
+
+void record_unmap(struct recording *recording) {
+	if (recording->header) munmap((void *) recording->header, recording->size);
+	*recording = (struct recording) {0};
+}
+
+double record_duration(const struct recording *recording) {
+	return (recording->records - 1) * recording->header->interval;
+}
+
+static double field(const struct recording *recording, uint64_t record, unsigned i) {
+	const char *data = recording->data + record * recording->header->record_size;
+	if (recording->header->flags & RECORD_FLOAT32) return ((const float *) data)[i];
+	return ((const double *) data)[i];
+}
+
+void record_sample(const struct recording *recording, double t, struct pendulum_system *system, double *ke, double *gpe) {
+	const struct record_header *header = recording->header;
+	double h = header->interval, pos = fmin(fmax(t / h, 0), recording->records - 1);
+	uint64_t a = pos, b = a + 1 < recording->records ? a + 1 : a;
+	double s = pos - a;
+
+	// cubic Hermite through the angles, since their derivatives are recorded too, and linear for the rest
+	double h00 = (2 * s - 3) * s * s + 1, h10 = ((s - 2) * s + 1) * s, h01 = (3 - 2 * s) * s * s, h11 = (s - 1) * s * s;
+	for (unsigned i = 0; i < header->count; ++i) {
+		double angle_a = field(recording, a, 2 + i * 2), angvel_a = field(recording, a, 3 + i * 2),
+		       angle_b = field(recording, b, 2 + i * 2), angvel_b = field(recording, b, 3 + i * 2);
+		system->angle[i] = h00 * angle_a + h10 * h * angvel_a + h01 * angle_b + h11 * h * angvel_b;
+		system->angvel[i] = angvel_a + s * (angvel_b - angvel_a);
+		system->mass[i] = recording->params[1 + i * 2];
+		system->length[i] = recording->params[2 + i * 2];
+	}
+	*ke = field(recording, a, 0) + s * (field(recording, b, 0) - field(recording, a, 0));
+	*gpe = field(recording, a, 1) + s * (field(recording, b, 1) - field(recording, a, 1));
+}
@@ -0,0 +1,62 @@
+#ifndef RECORD_H
+#define RECORD_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sim.h"
+
+// recorded trajectories, laid out so they can be mapped and indexed directly
+// a page holding the header and the parameters (gravity, then the mass and length of each pendulum, as doubles) is followed by
+// fixed-size records, each holding the kinetic energy, potential energy, then the angle and angular velocity of each pendulum
+// record i is the state at time i * interval, numbers are in native byte order, as doubles or with RECORD_FLOAT32 as floats
+
+#define RECORD_MAGIC "DPENDREC"
+#define RECORD_VERSION 1
+#define RECORD_ALIGN 4096 // records start on a page, and are written in multiples of it apart from the last write
+
+enum record_flags {
+	RECORD_FLOAT32 = 1 << 0,
+};
+
+struct record_header {
+	char magic[8];
+	uint32_t version, flags;
+	uint32_t count;       // pendulums
+	uint32_t record_size; // bytes
+	uint64_t data_offset; // of the first record
+	uint64_t records;     // written when the recording is finished, 0 while it's in progress
+	double interval;      // simulated seconds between records
+};
+
+#define RECORD_FIELDS(count) (2 + (count) * 2)
+
+struct recorder {
+	int fd;
+	struct record_header header;
+	char *buffer; // aligned, so the file could be opened with O_DIRECT
+	size_t used;
+	uint64_t written; // bytes of records
+	double *fields;
+	float *fields32;
+};
+
+// a recording mapped into memory for playback
+struct recording {
+	const struct record_header *header;
+	const double *params;
+	const char *data;
+	uint64_t records; // counted from the file size if the recording wasn't finished
+	size_t size;
+};
+
+bool record_open(struct recorder *recorder, const char *path, struct pendulum_system *system, double interval, bool float32);
+bool record_write(struct recorder *recorder, struct pendulum_system *system); // appends the current state
+bool record_close(struct recorder *recorder);                                // flushes and finishes the header
+
+bool record_map(struct recording *recording, const char *path);
+void record_unmap(struct recording *recording);
+double record_duration(const struct recording *recording);
+// fills in the state arrays of the system (which must have header->count pendulums) and energies at time t, interpolating
+// between records
+void record_sample(const struct recording *recording, double t, struct pendulum_system *system, double *ke, double *gpe);
+#endif
@@ -131,3 +131,83 @@ void rk4 ( void dydt ( double t, double u[], double f[] ), double tspan[2],
   return;
 }
 
+/******************************************************************************/
+
+void rk4_inplace ( void dydt ( double t, double u[], double f[], void *ctx ),
+  void *ctx, double t0, double dt, int n, int m, double y[], double scratch[],
+  void sink ( double t, const double y[], void *data ), void *data )
+
+/******************************************************************************/
+/*
+  Purpose:
+
+    rk4_inplace() takes the same steps as rk4(), overwriting the solution
+    instead of storing the whole trajectory, and without allocating.
+
+  Input:
+
+    double DYDT ( double T, double U, void *CTX ), as for rk4(), also
+    passed CTX.
+
+    double T0, DT: the initial time and the step size.
+
+    int N: the number of steps to take.
+
+    int M: the number of variables.
+
+    double Y[M]: the initial condition.
+
+    double SCRATCH[RK4_SCRATCH(M)]: working space.
+
+    SINK, DATA: if SINK is not NULL, it is called with the time and
+    solution after each step, and DATA.
+
+  Output:
+
+    double Y[M]: the solution at T0 + N * DT.
+*/
+{
+  double *f0 = scratch;
+  double *f1 = f0 + m;
+  double *f2 = f1 + m;
+  double *f3 = f2 + m;
+  double *u = f3 + m;
+  int i;
+  int j;
+
+  for ( j = 0; j < n; j++ )
+  {
+    dydt ( t0, y, f0, ctx );
+
+    for ( i = 0; i < m; i++ )
+    {
+      u[i] = y[i] + dt * f0[i] / 2.0;
+    }
+    dydt ( t0 + dt / 2.0, u, f1, ctx );
+
+    for ( i = 0; i < m; i++ )
+    {
+      u[i] = y[i] + dt * f1[i] / 2.0;
+    }
+    dydt ( t0 + dt / 2.0, u, f2, ctx );
+
+    for ( i = 0; i < m; i++ )
+    {
+      u[i] = y[i] + dt * f2[i];
+    }
+    dydt ( t0 + dt, u, f3, ctx );
+
+    t0 = t0 + dt;
+    for ( i = 0; i < m; i++ )
+    {
+      y[i] = y[i] + dt * ( f0[i] + 2.0 * f1[i] + 2.0 * f2[i] + f3[i] ) / 6.0;
+    }
+
+    if ( sink )
+    {
+      sink ( t0, y, data );
+    }
+  }
+
+  return;
+}
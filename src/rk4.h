@@ -2,3 +2,8 @@
 void rk4 ( void dydt ( double t, double u[], double f[] ), double tspan[2], 
   double y0[], int n, int m, double t[], double y[] );
 
+# define RK4_SCRATCH(m) ( ( m ) * 5 )
+
+void rk4_inplace ( void dydt ( double t, double u[], double f[], void *ctx ),
+  void *ctx, double t0, double dt, int n, int m, double y[], double scratch[],
+  void sink ( double t, const double y[], void *data ), void *data );
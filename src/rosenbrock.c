@@ -0,0 +1,73 @@
+#include "rosenbrock.h"
+#include "lu.h"
+#include <math.h>
+#include <string.h>
+
+// ROS2 (Verwer et al. 1999), second order and L-stable, each step of size h is
+//   (I - γhJ) k₁ = f(y)
+//   (I - γhJ) k₂ = f(y + h k₁) - 2 k₁
+//   y' = y + 3/2 h k₁ + 1/2 h k₂
+// with J = ∂f/∂y at the start of the step, so it takes one Jacobian, one factorisation and two evaluations of the equations of
+// motion, and no iteration
+
+#define GAMMA (1 + M_SQRT1_2)
+
+static void angacc(struct pendulum_system *system, const double *y, double *out) {
+	const struct tape *tape = &system->tape_angacc;
+	memcpy(sim_load_params(system, system->regs_angacc), y, system->count * 2 * sizeof(*y));
+	tape_run(tape, system->regs_angacc);
+	for (unsigned i = 0; i < tape->outputs; ++i) out[i] = system->regs_angacc[tape->output[i]];
+	++system->evaluations;
+}
+
+// with the state as (angles x, angular velocities v), J = [[0, I], [A, B]] where A = ∂a/∂x and B = ∂a/∂v
+// the first n rows of (I - γhJ) k = r say k_x = r_x + γh k_v, which leaves (I - γh B - (γh)² A) k_v = r_v + γh A r_x, so only an
+// n by n matrix is factorised, in m
+// r and k may be the same
+static void solve(unsigned n, const double *m, const unsigned *pivot, const double *a, double gh, const double *r, double *k,
+                  double *rhs) {
+	for (unsigned i = 0; i < n; ++i) {
+		rhs[i] = r[n + i];
+		for (unsigned j = 0; j < n; ++j) rhs[i] += gh * a[i * n + j] * r[j];
+	}
+	lu_solve(n, m, pivot, rhs, k + n);
+	for (unsigned i = 0; i < n; ++i) k[i] = r[i] + gh * k[n + i];
+}
+
+bool rosenbrock_step(struct pendulum_system *system, int steps, double time_span, sim_sink *sink, void *data) {
+	if (!system->rosenbrock) return false;
+
+	const struct tape *tape = &system->tape_jacobian;
+	unsigned n = system->count, *pivot = system->pivot;
+	double h = time_span / steps, gh = GAMMA * h, *regs = system->regs_jacobian;
+	double *y = system->angle; // the state arrays are stepped in place, angvel follows angle
+	double *k1 = system->rosenbrock, *k2 = k1 + n * 2, *u = k2 + n * 2, *rhs = u + n * 2, *a = rhs + n, *m = a + n * n;
+
+	for (int step = 0; step < steps; ++step) {
+		// the accelerations and their derivatives come from one run, see sim_init
+		memcpy(sim_load_params(system, regs), y, n * 2 * sizeof(*y));
+		tape_run(tape, regs);
+		++system->evaluations;
+		for (unsigned i = 0; i < n; ++i) {
+			k1[i] = y[n + i];
+			k1[n + i] = regs[tape->output[i]];
+			for (unsigned j = 0; j < n; ++j) {
+				double da_dx = regs[tape->output[n + i * n + j]], da_dv = regs[tape->output[n + n * n + i * n + j]];
+				a[i * n + j] = da_dx;
+				m[i * n + j] = (i == j) - gh * da_dv - gh * gh * da_dx;
+			}
+		}
+		if (!lu_factor(n, m, pivot)) return false;
+		solve(n, m, pivot, a, gh, k1, k1, rhs);
+
+		for (unsigned i = 0; i < n * 2; ++i) u[i] = y[i] + h * k1[i];
+		memcpy(k2, u + n, n * sizeof(*k2));
+		angacc(system, u, k2 + n);
+		for (unsigned i = 0; i < n * 2; ++i) k2[i] -= 2 * k1[i];
+		solve(n, m, pivot, a, gh, k2, k2, rhs);
+
+		for (unsigned i = 0; i < n * 2; ++i) y[i] += h * (1.5 * k1[i] + 0.5 * k2[i]);
+		if (sink) sink((step + 1) * h, y, data);
+	}
+	return true;
+}
@@ -0,0 +1,12 @@
+#ifndef ROSENBROCK_H
+#define ROSENBROCK_H
+#include "sim.h"
+
+// linearly implicit two stage Rosenbrock method (ROS2), which stays stable at step sizes far beyond what RK4 can take on stiff
+// chains, such as a heavy link followed by very light ones
+// needs the Jacobian tape that sim_init derives from the solutions for SIM_INTEGRATOR_ROSENBROCK
+
+#define ROSENBROCK_SCRATCH(count) ((count) * 7 + (count) * (count) * 2) // doubles of scratch space needed by rosenbrock_step
+
+bool rosenbrock_step(struct pendulum_system *system, int steps, double time_span, sim_sink *sink, void *data);
+#endif
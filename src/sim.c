@@ -1,5 +1,16 @@
 #include "sim.h"
 #include "rk4.h"
+#include "chain.h"
+#include "cache.h"
+#include "symplectic.h"
+#include "rosenbrock.h"
+#include "util.h"
+#include "config.h"
+#ifdef SIM_KERNEL
+#include "kernel.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
 
 static unsigned log10i(size_t x) {
 	unsigned i;
@@ -14,20 +25,73 @@ static unsigned log10i(size_t x) {
 #define HEAP_FREE(x) \
 	if (x) x = (basic_free_heap(x), NULL)
 
+// change this whenever the derivation below changes, to invalidate cached equations of motion
+static const char derivation_version[] = "1";
+
+bool sim_state_alloc(struct pendulum_system *system) {
+	double *memory = calloc((size_t) system->count * 4, sizeof(*memory));
+	if (!memory) return false;
+	system->mass = memory;
+	system->length = system->mass + system->count;
+	system->angle = system->length + system->count;
+	system->angvel = system->angle + system->count;
+	if (system->chain)
+		for (unsigned i = 0; i < system->count; ++i) {
+			system->mass[i] = system->chain[i].mass;
+			system->length[i] = system->chain[i].length;
+			system->angle[i] = system->chain[i].angle;
+			system->angvel[i] = system->chain[i].angvel;
+		}
+	return true;
+}
+
+void sim_state_free(struct pendulum_system *system) {
+	FREE(system->mass);
+	system->length = system->angle = system->angvel = NULL;
+}
+
 bool sim_init(struct pendulum_system *system) {
+	if (!system->mass && !sim_state_alloc(system)) return false;
+
+	if (system->engine == SIM_ENGINE_NUMERIC && system->integrator == SIM_INTEGRATOR_SYMPLECTIC) {
+		fprintf(stderr, "The symplectic integrator needs the symbolic engine\n");
+		return false;
+	}
+	if (system->engine == SIM_ENGINE_NUMERIC && system->integrator == SIM_INTEGRATOR_ROSENBROCK) {
+		fprintf(stderr, "The Rosenbrock integrator needs the symbolic engine\n");
+		return false;
+	}
+
+	if (system->engine == SIM_ENGINE_NUMERIC) {
+		system->scratch = calloc(CHAIN_SCRATCH(system->count) + 1 + system->count * 2, sizeof(*system->scratch));
+		return system->scratch != NULL;
+	}
+
+#ifdef SIM_KERNEL
+	// the generated kernel already has the solutions for this chain length, skip the derivation
+	// unless the symplectic integrator needs the Lagrangian or the Rosenbrock integrator needs the Jacobian
+	if (system->count == kernel_count && system->integrator != SIM_INTEGRATOR_SYMPLECTIC && system->integrator != SIM_INTEGRATOR_ROSENBROCK) {
+		system->kernel = true;
+		system->scratch = calloc(1 + system->count * 2, sizeof(*system->scratch));
+		return system->scratch != NULL;
+	}
+#endif
+
 	bool ret = false;
 	CWRAPPER_OUTPUT_TYPE res = 0;
 
 	// initialise temp variables
-	basic temp, vx, vy, vlx, vly, half, one, t_angvel, t_angle;
+	basic temp, vx, vy, vlx, vly, height, half, one, t_angvel, t_angle;
 	CVecBasic *time_args = NULL,
-	          *acc_system = NULL, *acc_solution = NULL, *acc_symbol = NULL;
+	          *acc_system = NULL, *acc_solution = NULL, *acc_symbol = NULL,
+	          *tape_inputs = NULL, *energy = NULL, *mass = NULL, *force = NULL, *jacobian = NULL;
 	CMapBasicBasic *to_func_subs = NULL, *to_sym_subs = NULL;
 	basic_new_stack(temp);
 	basic_new_stack(vx);
 	basic_new_stack(vy);
 	basic_new_stack(vlx);
 	basic_new_stack(vly);
+	basic_new_stack(height);
 	basic_new_stack(half);
 	basic_new_stack(one);
 	basic_new_stack(t_angvel);
@@ -46,6 +110,7 @@ bool sim_init(struct pendulum_system *system) {
 	basic_const_zero(system->gpe);
 	basic_const_zero(vx);
 	basic_const_zero(vy);
+	basic_const_zero(height);
 	ASSERT(rational_set_ui(half, 1, 2));
 	basic_const_one(one);
 
@@ -66,15 +131,18 @@ bool sim_init(struct pendulum_system *system) {
 	to_sym_subs = mapbasicbasic_new();
 	if (!to_sym_subs) goto fail;
 
+	system->symbols = calloc(system->count, sizeof(*system->symbols));
+	if (!system->symbols) goto fail;
+
 	for (unsigned i = 0; i < system->count; ++i) {
-		struct pendulum *p = &system->chain[i];
+		struct pendulum_symbols *p = &system->symbols[i];
 
 		// initialise symbols for pendulum
-		HEAP_ALLOC(p->sym_mass);
-		HEAP_ALLOC(p->sym_length);
-		HEAP_ALLOC(p->sym_angle);
-		HEAP_ALLOC(p->sym_angvel);
-		HEAP_ALLOC(p->sym_angacc);
+		HEAP_ALLOC(p->mass);
+		HEAP_ALLOC(p->length);
+		HEAP_ALLOC(p->angle);
+		HEAP_ALLOC(p->angvel);
+		HEAP_ALLOC(p->angacc);
 		HEAP_ALLOC(p->func_angle);
 		HEAP_ALLOC(p->func_angvel);
 		HEAP_ALLOC(p->func_angacc);
@@ -89,28 +157,39 @@ bool sim_init(struct pendulum_system *system) {
 
 		// define symbols
 		str[0] = 'm';
-		ASSERT(symbol_set(p->sym_mass, str));
+		ASSERT(symbol_set(p->mass, str));
 		str[0] = 'l';
-		ASSERT(symbol_set(p->sym_length, str));
+		ASSERT(symbol_set(p->length, str));
 		str[0] = 'x';
-		ASSERT(symbol_set(p->sym_angle, str));
+		ASSERT(symbol_set(p->angle, str));
 		str[0] = 'v';
-		ASSERT(symbol_set(p->sym_angvel, str));
+		ASSERT(symbol_set(p->angvel, str));
 		str[0] = 'a';
-		ASSERT(symbol_set(p->sym_angacc, str));
+		ASSERT(symbol_set(p->angacc, str));
 
 		// define angle and angular velocity functions
 		str[0] = 'f';
 		ASSERT(function_symbol_set(p->func_angle, str, time_args));
 		ASSERT(basic_diff(p->func_angvel, p->func_angle, system->time));
 		ASSERT(basic_diff(p->func_angacc, p->func_angvel, system->time));
+	}
+
+	// reuse the equations of motion from a previous run if they are cached
+	if (cache_load(system, derivation_version)) {
+		ASSERT(basic_sub(system->lagrangian, system->ke, system->gpe));
+		for (unsigned i = 0; i < system->count; ++i) vecbasic_push_back(acc_solution, system->symbols[i].solution_angacc);
+		goto lower;
+	}
+
+	for (unsigned i = 0; i < system->count; ++i) {
+		struct pendulum_symbols *p = &system->symbols[i];
 
 		// define the kinetic energy
 
-		ASSERT(basic_sin(vlx, p->sym_angle));
-		ASSERT(basic_cos(vly, p->sym_angle));
+		ASSERT(basic_sin(vlx, p->angle));
+		ASSERT(basic_cos(vly, p->angle));
 
-		ASSERT(basic_mul(temp, p->sym_length, p->sym_angvel)); // v = rω
+		ASSERT(basic_mul(temp, p->length, p->angvel)); // v = rω
 		ASSERT(basic_mul(vlx, vlx, temp));
 		ASSERT(basic_mul(vly, vly, temp));
 
@@ -124,7 +203,7 @@ bool sim_init(struct pendulum_system *system) {
 		ASSERT(basic_add(temp, vlx, vly));
 
 		// multiply by mass and halve
-		ASSERT(basic_mul(temp, temp, p->sym_mass));
+		ASSERT(basic_mul(temp, temp, p->mass));
 		ASSERT(basic_mul(temp, temp, half));
 
 		// add value, KE=0.5mv^2
@@ -132,11 +211,12 @@ bool sim_init(struct pendulum_system *system) {
 
 		// define the gravitational potential energy
 
-		ASSERT(basic_cos(vly, p->sym_angle)); // cos is in the vertical axis, unlike the unit circle
-		ASSERT(basic_sub(vly, one, vly));     // flip vertically
-		ASSERT(basic_mul(vly, vly, p->sym_length));
-		ASSERT(basic_mul(temp, vly, system->sym_gravity)); // multiply by gravity
-		ASSERT(basic_mul(temp, temp, p->sym_mass));        // multiply by mass
+		ASSERT(basic_cos(vly, p->angle));                     // cos is in the vertical axis, unlike the unit circle
+		ASSERT(basic_sub(vly, one, vly));                     // flip vertically
+		ASSERT(basic_mul(vly, vly, p->length));
+		ASSERT(basic_add(height, height, vly));               // the pendulum hangs from the end of the previous one
+		ASSERT(basic_mul(temp, height, system->sym_gravity)); // multiply by gravity
+		ASSERT(basic_mul(temp, temp, p->mass));               // multiply by mass
 
 		// add value, GPE=mgh
 		ASSERT(basic_add(system->gpe, system->gpe, temp));
@@ -146,29 +226,29 @@ bool sim_init(struct pendulum_system *system) {
 	ASSERT(basic_sub(system->lagrangian, system->ke, system->gpe)); // L = T (kinetic) - V (potential)
 
 	for (unsigned i = 0; i < system->count; ++i) {
-		struct pendulum *p = &system->chain[i];
+		struct pendulum_symbols *p = &system->symbols[i];
 
-		mapbasicbasic_insert(to_func_subs, p->sym_angacc, p->func_angacc);
-		mapbasicbasic_insert(to_func_subs, p->sym_angvel, p->func_angvel);
-		mapbasicbasic_insert(to_func_subs, p->sym_angle, p->func_angle);
+		mapbasicbasic_insert(to_func_subs, p->angacc, p->func_angacc);
+		mapbasicbasic_insert(to_func_subs, p->angvel, p->func_angvel);
+		mapbasicbasic_insert(to_func_subs, p->angle, p->func_angle);
 
-		mapbasicbasic_insert(to_sym_subs, p->func_angacc, p->sym_angacc);
-		mapbasicbasic_insert(to_sym_subs, p->func_angvel, p->sym_angvel);
-		mapbasicbasic_insert(to_sym_subs, p->func_angle, p->sym_angle);
+		mapbasicbasic_insert(to_sym_subs, p->func_angacc, p->angacc);
+		mapbasicbasic_insert(to_sym_subs, p->func_angvel, p->angvel);
+		mapbasicbasic_insert(to_sym_subs, p->func_angle, p->angle);
 	}
 
 	for (unsigned i = 0; i < system->count; ++i) {
-		struct pendulum *p = &system->chain[i];
+		struct pendulum_symbols *p = &system->symbols[i];
 
 		// https://en.wikipedia.org/wiki/Lagrangian_mechanics#Equations_of_motion
 
 		// partially differentiate Lagrangian function
 		// these are taken separately for each axis
-		ASSERT(basic_diff(t_angle, system->lagrangian, p->sym_angle));
+		ASSERT(basic_diff(t_angle, system->lagrangian, p->angle));
 		// note that angular velocity is treated as a separate variable to angle when finding this partial derivative,
 		// instead of as the derivative of the angle w.r.t. time
 		// see https://math.stackexchange.com/a/2085001
-		ASSERT(basic_diff(t_angvel, system->lagrangian, p->sym_angvel));
+		ASSERT(basic_diff(t_angvel, system->lagrangian, p->angvel));
 
 		// implement Lagrange's equations
 
@@ -186,7 +266,7 @@ bool sim_init(struct pendulum_system *system) {
 
 		// add equation in system of equations to solve for angular acceleration
 		vecbasic_push_back(acc_system, p->equation_of_motion);
-		vecbasic_push_back(acc_symbol, p->sym_angacc);
+		vecbasic_push_back(acc_symbol, p->angacc);
 	}
 
 	// solve system of equations for angular acceleration
@@ -194,7 +274,79 @@ bool sim_init(struct pendulum_system *system) {
 
 	// assign solutions for each angular acceleration
 	for (unsigned i = 0; i < system->count; ++i) {
-		ASSERT(vecbasic_get(acc_solution, i, system->chain[i].solution_angacc));
+		ASSERT(vecbasic_get(acc_solution, i, system->symbols[i].solution_angacc));
+	}
+
+	if (!cache_save(system, derivation_version)) fprintf(stderr, "Failed to cache the equations of motion\n");
+
+lower:
+	// lower the solutions and energies into numeric programs, so they don't need to be substituted every step
+	tape_inputs = vecbasic_new();
+	if (!tape_inputs) goto fail;
+	energy = vecbasic_new();
+	if (!energy) goto fail;
+
+	vecbasic_push_back(tape_inputs, system->sym_gravity);
+	for (unsigned i = 0; i < system->count; ++i) vecbasic_push_back(tape_inputs, system->symbols[i].mass);
+	for (unsigned i = 0; i < system->count; ++i) vecbasic_push_back(tape_inputs, system->symbols[i].length);
+	for (unsigned i = 0; i < system->count; ++i) vecbasic_push_back(tape_inputs, system->symbols[i].angle);
+	for (unsigned i = 0; i < system->count; ++i) vecbasic_push_back(tape_inputs, system->symbols[i].angvel);
+	vecbasic_push_back(energy, system->ke);
+	vecbasic_push_back(energy, system->gpe);
+
+	if (!tape_compile(&system->tape_angacc, tape_inputs, acc_solution)) goto fail;
+	if (!tape_compile(&system->tape_energy, tape_inputs, energy)) goto fail;
+	if (!(system->regs_angacc = tape_regs_new(&system->tape_angacc, 1))) goto fail;
+	if (!(system->regs_energy = tape_regs_new(&system->tape_energy, 1))) goto fail;
+
+	if (system->integrator == SIM_INTEGRATOR_SYMPLECTIC) {
+		mass = vecbasic_new();
+		if (!mass) goto fail;
+		force = vecbasic_new();
+		if (!force) goto fail;
+
+		for (unsigned i = 0; i < system->count; ++i) {
+			ASSERT(basic_diff(t_angle, system->lagrangian, system->symbols[i].angle));
+			vecbasic_push_back(force, t_angle);
+
+			// the Lagrangian is quadratic in the angular velocities, so this doesn't depend on them
+			ASSERT(basic_diff(t_angvel, system->lagrangian, system->symbols[i].angvel));
+			for (unsigned j = 0; j < system->count; ++j) {
+				ASSERT(basic_diff(temp, t_angvel, system->symbols[j].angvel));
+				vecbasic_push_back(mass, temp);
+			}
+		}
+
+		if (!tape_compile(&system->tape_mass, tape_inputs, mass)) goto fail;
+		if (!tape_compile(&system->tape_force, tape_inputs, force)) goto fail;
+		if (!(system->regs_mass = tape_regs_new(&system->tape_mass, 1))) goto fail;
+		if (!(system->regs_force = tape_regs_new(&system->tape_force, 1))) goto fail;
+		if (!(system->symplectic = calloc(SYMPLECTIC_SCRATCH(system->count), sizeof(*system->symplectic)))) goto fail;
+		if (!(system->pivot = calloc(system->count, sizeof(*system->pivot)))) goto fail;
+	}
+
+	if (system->integrator == SIM_INTEGRATOR_ROSENBROCK) {
+		jacobian = vecbasic_new();
+		if (!jacobian) goto fail;
+
+		// the accelerations go in the same tape as their derivatives, so a step gets both from one run that shares their
+		// subexpressions
+		for (unsigned i = 0; i < system->count; ++i) vecbasic_push_back(jacobian, system->symbols[i].solution_angacc);
+		for (unsigned i = 0; i < system->count; ++i)
+			for (unsigned j = 0; j < system->count; ++j) {
+				ASSERT(basic_diff(temp, system->symbols[i].solution_angacc, system->symbols[j].angle));
+				vecbasic_push_back(jacobian, temp);
+			}
+		for (unsigned i = 0; i < system->count; ++i)
+			for (unsigned j = 0; j < system->count; ++j) {
+				ASSERT(basic_diff(temp, system->symbols[i].solution_angacc, system->symbols[j].angvel));
+				vecbasic_push_back(jacobian, temp);
+			}
+
+		if (!tape_compile(&system->tape_jacobian, tape_inputs, jacobian)) goto fail;
+		if (!(system->regs_jacobian = tape_regs_new(&system->tape_jacobian, 1))) goto fail;
+		if (!(system->rosenbrock = calloc(ROSENBROCK_SCRATCH(system->count), sizeof(*system->rosenbrock)))) goto fail;
+		if (!(system->pivot = calloc(system->count, sizeof(*system->pivot)))) goto fail;
 	}
 
 	ret = true;
@@ -205,6 +357,7 @@ fail:
 	basic_free_stack(vy);
 	basic_free_stack(vlx);
 	basic_free_stack(vly);
+	basic_free_stack(height);
 	basic_free_stack(half);
 	basic_free_stack(one);
 	basic_free_stack(t_angvel);
@@ -214,6 +367,11 @@ fail:
 	vecbasic_free(acc_system);
 	vecbasic_free(acc_solution);
 	vecbasic_free(acc_symbol);
+	vecbasic_free(tape_inputs);
+	vecbasic_free(energy);
+	vecbasic_free(mass);
+	vecbasic_free(force);
+	vecbasic_free(jacobian);
 
 	mapbasicbasic_free(to_func_subs);
 	mapbasicbasic_free(to_sym_subs);
@@ -232,19 +390,37 @@ bool sim_free(struct pendulum_system *system) {
 	HEAP_FREE(system->gpe);
 	HEAP_FREE(system->lagrangian);
 	HEAP_FREE(system->time);
-	for (unsigned i = 0; i < system->count; ++i) {
-		struct pendulum *p = &system->chain[i];
-		HEAP_FREE(p->sym_mass);
-		HEAP_FREE(p->sym_length);
-		HEAP_FREE(p->sym_angle);
-		HEAP_FREE(p->sym_angvel);
-		HEAP_FREE(p->sym_angacc);
+	for (unsigned i = 0; system->symbols && i < system->count; ++i) {
+		struct pendulum_symbols *p = &system->symbols[i];
+		HEAP_FREE(p->mass);
+		HEAP_FREE(p->length);
+		HEAP_FREE(p->angle);
+		HEAP_FREE(p->angvel);
+		HEAP_FREE(p->angacc);
 		HEAP_FREE(p->func_angle);
 		HEAP_FREE(p->func_angvel);
 		HEAP_FREE(p->func_angacc);
 		HEAP_FREE(p->equation_of_motion);
 		HEAP_FREE(p->solution_angacc);
 	}
+	FREE(system->symbols);
+	tape_free(&system->tape_angacc);
+	tape_free(&system->tape_energy);
+	FREE(system->regs_angacc);
+	FREE(system->regs_energy);
+	FREE(system->scratch);
+	FREE(system->step_scratch);
+	dopri_free(&system->dopri);
+	tape_free(&system->tape_mass);
+	tape_free(&system->tape_force);
+	FREE(system->regs_mass);
+	FREE(system->regs_force);
+	FREE(system->symplectic);
+	tape_free(&system->tape_jacobian);
+	FREE(system->regs_jacobian);
+	FREE(system->rosenbrock);
+	FREE(system->pivot);
+	system->kernel = false;
 	return true;
 }
 
@@ -263,11 +439,11 @@ static CWRAPPER_OUTPUT_TYPE basic_substitute(basic out, basic in, struct pendulu
 	// substitute in real numbers
 	SUBS(system->sym_gravity, system->gravity);
 	for (int j = 0; j < system->count; ++j) {
-		struct pendulum *pend = &system->chain[j];
-		SUBS(pend->sym_mass, pend->mass);
-		SUBS(pend->sym_length, pend->length);
-		SUBS(pend->sym_angle, pend->angle);
-		SUBS(pend->sym_angvel, pend->angvel);
+		struct pendulum_symbols *pend = &system->symbols[j];
+		SUBS(pend->mass, system->mass[j]);
+		SUBS(pend->length, system->length[j]);
+		SUBS(pend->angle, system->angle[j]);
+		SUBS(pend->angvel, system->angvel[j]);
 	}
 
 #undef SUBS
@@ -278,6 +454,8 @@ fail:
 }
 
 bool sim_substitute(double *out, basic in, struct pendulum_system *system) {
+	if (!system->sym_gravity) return false; // nothing was derived symbolically
+
 	basic sym_out;
 	basic_new_stack(sym_out);
 	if (basic_substitute(sym_out, in, system)) {
@@ -290,67 +468,119 @@ bool sim_substitute(double *out, basic in, struct pendulum_system *system) {
 	return true;
 }
 
-static const int var_per_pendulum = 2;
+// writes gravity, then the mass and length arrays into the input registers, returning where the state inputs begin
+double *sim_load_params(const struct pendulum_system *system, double *regs) {
+	*regs++ = system->gravity;
+	memcpy(regs, system->mass, system->count * 2 * sizeof(*regs)); // length follows mass
+	return regs + system->count * 2;
+}
 
-static struct pendulum_system *dydt_system;
-static bool dydt_success;
+bool sim_energy(struct pendulum_system *system, double *ke, double *gpe) {
+	double *regs = system->engine == SIM_ENGINE_NUMERIC ? system->scratch + CHAIN_SCRATCH(system->count)
+	               : system->kernel                     ? system->scratch
+	                                                    : system->regs_energy;
+	if (!regs) return false;
 
-static void dydt(double t, double y[], double out[]) {
-	struct pendulum_system *system = dydt_system;
+	double *state = sim_load_params(system, regs);
 
-	// set all zeros beforehand as failsafe
-	for (int i = 0; i < system->count; ++i) out[i * var_per_pendulum] = 0, out[i * var_per_pendulum + 1] = 0;
+	if (system->engine == SIM_ENGINE_NUMERIC) {
+		chain_energy(system->count, regs, system->angle, ke, gpe);
+		return true;
+	}
 
-	for (int i = 0; i < system->count; ++i) {
-		struct pendulum *pend = &system->chain[i];
+#ifdef SIM_KERNEL
+	if (system->kernel) {
+		*ke = kernel_ke(regs, system->angle);
+		*gpe = kernel_gpe(regs, system->angle);
+		return true;
+	}
+#endif
 
-		for (int j = 0; j < system->count; ++j) {
-			struct pendulum *pend2 = &system->chain[j];
-			// using values from the solver
-			pend2->angle = y[j * var_per_pendulum];
-			pend2->angvel = y[j * var_per_pendulum + 1];
-		}
+	memcpy(state, system->angle, system->count * 2 * sizeof(*state));
+	tape_run(&system->tape_energy, regs);
+	*ke = regs[system->tape_energy.output[0]];
+	*gpe = regs[system->tape_energy.output[1]];
+	return true;
+}
+
+// only touches the scratch space of the system, so separate systems can be stepped from separate threads
+static void dydt(double t, double y[], double out[], void *ctx) {
+	struct pendulum_system *system = ctx;
+	++system->evaluations;
 
-		double angacc;
-		if (!sim_substitute(&angacc, pend->solution_angacc, system)) goto fail;
+	unsigned count = system->count;
+	memcpy(out, y + count, count * sizeof(*out)); // angle changes by angular velocity
+	double *angacc = out + count;                 // angular velocity changes by angular acceleration
 
-		out[i * var_per_pendulum] = y[i * var_per_pendulum + 1]; // angle changes by angular velocity
-		out[i * var_per_pendulum + 1] = angacc;                  // angular velocity changes by angular acceleration
+	if (system->engine == SIM_ENGINE_NUMERIC) {
+		double *params = system->scratch + CHAIN_SCRATCH(count);
+		sim_load_params(system, params);
+		chain_angacc(count, params, y, angacc, system->scratch);
+		return;
 	}
 
-	dydt_success = true;
-fail:
+#ifdef SIM_KERNEL
+	if (system->kernel) {
+		sim_load_params(system, system->scratch);
+		kernel_angacc(system->scratch, y, angacc);
+		return;
+	}
+#endif
+
+	double *regs = system->regs_angacc;
+
+	// the state vector has the same layout as the state inputs
+	memcpy(sim_load_params(system, regs), y, count * 2 * sizeof(*y));
+	tape_run(&system->tape_angacc, regs);
+
+	for (unsigned i = 0; i < count; ++i) angacc[i] = regs[system->tape_angacc.output[i]];
+}
+
+// the integrator keeps its own solution, which may be ahead of the pendulums, and interpolates back to the end of each span
+static bool step_dopri(struct pendulum_system *system, double time_span, double *y) {
+	struct dopri *dopri = &system->dopri;
+	int variables = system->count * 2;
+	if (!dopri->memory && !dopri_init(dopri, variables, DOPRI_ATOL, DOPRI_RTOL)) return false;
+
+	// start again if the pendulums were moved since the last step, or this is the first one
+	if (dopri->t_out == 0 || memcmp(y, dopri->out, variables * sizeof(*y))) dopri_reset(dopri, 0, y);
+
+	unsigned long accepted = dopri->accepted;
+	if (!dopri_advance(dopri, dydt, system, dopri->t_out + time_span)) return false; // may only interpolate, without calling dydt
+	system->steps += dopri->accepted - accepted;
+	memcpy(y, dopri->out, variables * sizeof(*y));
+	return true;
 }
 
 bool sim_step(struct pendulum_system *system, int steps, double time_span) {
+	return sim_step_sink(system, steps, time_span, NULL, NULL);
+}
+
+bool sim_step_sink(struct pendulum_system *system, int steps, double time_span, sim_sink *sink, void *data) {
 	if (steps < 1) return false;
 	if (time_span <= 0) return false;
 
-	dydt_system = system;
-	int variables = system->count * var_per_pendulum;
-	double tspan[2] = {0, time_span};
-	double y[variables * (steps + 1)];
-	double t[steps + 1];
-
-	// copy pendulum data into input
-	for (unsigned i = 0; i < system->count; ++i) {
-		struct pendulum *p = &system->chain[i];
-		y[i * var_per_pendulum] = p->angle;
-		y[i * var_per_pendulum + 1] = p->angvel;
+	if (system->integrator == SIM_INTEGRATOR_SYMPLECTIC || system->integrator == SIM_INTEGRATOR_ROSENBROCK) {
+		bool ok = system->integrator == SIM_INTEGRATOR_SYMPLECTIC ? symplectic_step(system, steps, time_span, sink, data)
+		                                                          : rosenbrock_step(system, steps, time_span, sink, data);
+		if (ok) system->steps += steps;
+		return ok;
 	}
 
-	// perform Runge-Kutta order 4
-	dydt_success = false;
-	rk4(dydt, tspan, y, steps, variables, t, y);
-	if (!dydt_success) return false;
+	// the angle and angvel arrays are the state vector, so they are stepped where they are
+	int variables = system->count * 2;
+	double *y = system->angle;
 
-	// copy output back into pendulum data
-	double *final_y = &y[variables * steps];
-	for (unsigned i = 0; i < system->count; ++i) {
-		struct pendulum *p = &system->chain[i];
-		p->angle = final_y[i * var_per_pendulum];
-		p->angvel = final_y[i * var_per_pendulum + 1];
+	if (system->integrator == SIM_INTEGRATOR_DOPRI5) {
+		if (!step_dopri(system, time_span, y)) return false;
+		if (sink) sink(time_span, y, data);
+		return true;
 	}
 
+	if (!system->step_scratch && !(system->step_scratch = malloc(RK4_SCRATCH(variables) * sizeof(*system->step_scratch))))
+		return false;
+	// perform Runge-Kutta order 4, in place
+	rk4_inplace(dydt, system, 0, time_span / (double) steps, steps, variables, y, system->step_scratch, sink, data);
+	system->steps += steps;
 	return true;
 }
@@ -2,24 +2,80 @@
 #define SIM_H
 #include <symengine/cwrapper.h>
 #include <stdbool.h>
+#include "tape.h"
+#include "dopri.h"
 
+// initial conditions of a pendulum, copied into the state arrays of the system by sim_state_alloc
 struct pendulum {
 	double mass, length, angle, angvel;
-	basic_struct *sym_mass, *sym_length, *sym_angle, *sym_angvel, *sym_angacc, *solution_angacc,
+};
+
+// symbolic handles of a pendulum, allocated by sim_init unless the kernel or numeric engine is used, and kept until sim_free for
+// sim_substitute and the equation cache
+struct pendulum_symbols {
+	basic_struct *mass, *length, *angle, *angvel, *angacc, *solution_angacc,
 	        *equation_of_motion,
 	        *func_angle, *func_angvel, *func_angacc;
 };
 
+enum sim_engine {
+	SIM_ENGINE_SYMBOLIC, // derive the equations of motion with SymEngine at startup
+	SIM_ENGINE_NUMERIC,  // solve for the accelerations numerically every evaluation in O(count), for long chains
+};
+
+enum sim_integrator {
+	SIM_INTEGRATOR_RK4,    // fixed steps
+	SIM_INTEGRATOR_DOPRI5, // adaptive steps to within DOPRI_ATOL and DOPRI_RTOL, ignoring the step count
+	SIM_INTEGRATOR_SYMPLECTIC, // fixed generalised leapfrog steps, keeping the energy error bounded, symbolic engine only
+	SIM_INTEGRATOR_ROSENBROCK, // fixed linearly implicit steps, stable far beyond RK4 on stiff chains, symbolic engine only
+};
+
 struct pendulum_system {
+	enum sim_engine engine;
+	enum sim_integrator integrator;
 	double gravity;
 	basic_struct *sym_gravity,
 	        *time, *ke, *gpe, *lagrangian;
 	unsigned count;
-	struct pendulum *chain;
+	struct pendulum *chain; // initial conditions, may be NULL to start from zero
+	// numeric state as a structure of arrays in one allocation, laid out like the inputs of the equations of motion after gravity
+	// angvel follows angle, so angle is also the state vector the integrators step in place
+	double *mass, *length, *angle, *angvel;
+	struct pendulum_symbols *symbols; // one per pendulum, see above
+	// solutions lowered to numeric programs over (gravity, the mass of each pendulum, the length of each, the angle of each,
+	// the angular velocity of each)
+	struct tape tape_angacc, tape_energy;
+	double *regs_angacc, *regs_energy;
+	// set when the chain length matches the generated kernel, in which case nothing is derived symbolically
+	bool kernel;
+	double *scratch; // numeric engine or kernel inputs
+	double *step_scratch; // RK4 scratch, kept between steps
+	struct dopri dopri;
+	// mass matrix (∂²L/∂v_i∂v_j, row-major) and generalised forces (∂L/∂x_i) for the symplectic integrator, same inputs as above
+	struct tape tape_mass, tape_force;
+	double *regs_mass, *regs_force, *symplectic;
+	// the angular accelerations, then their derivatives by each angle and by each angular velocity (row-major) for the Rosenbrock
+	// integrator, same inputs as above
+	struct tape tape_jacobian;
+	double *regs_jacobian, *rosenbrock;
+	unsigned *pivot;
+	unsigned long steps; // integration steps taken, which dopri5 picks itself
+	unsigned long evaluations; // of the equations of motion, for comparing integrators
+	unsigned long mass_evaluations, force_evaluations; // of the mass matrix and generalised forces by the symplectic integrator
 };
 
 bool sim_substitute(double *out, basic in, struct pendulum_system *system);
-bool sim_init(struct pendulum_system *system);
+// the state arrays outlive sim_free, so the simulation can be stopped and initialised again where it left off
+bool sim_state_alloc(struct pendulum_system *system);
+void sim_state_free(struct pendulum_system *system);
+bool sim_init(struct pendulum_system *system); // also allocates the state arrays if they aren't yet
+bool sim_energy(struct pendulum_system *system, double *ke, double *gpe);
+// receives the time since the start of the span and the state, laid out like the angle and angvel arrays
+typedef void sim_sink(double t, const double *y, void *data);
+
 bool sim_step(struct pendulum_system *system, int steps, double time_span);
+// the same, also passing the state after every step to sink, or only at the end of the span for dopri5
+bool sim_step_sink(struct pendulum_system *system, int steps, double time_span, sim_sink *sink, void *data);
+double *sim_load_params(const struct pendulum_system *system, double *regs);
 bool sim_free(struct pendulum_system *system);
 #endif
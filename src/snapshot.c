@@ -0,0 +1,42 @@
+#include "snapshot.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAPSHOT_FRESH 4
+
+bool snapshot_init(struct snapshot_buffer *buffer, unsigned count) {
+	buffer->count = count;
+	buffer->memory = calloc(3 * 3 * count, sizeof(double));
+	if (!buffer->memory && count) return false;
+	for (unsigned i = 0; i < 3; ++i) {
+		buffer->slot[i] = (struct snapshot) {0};
+		buffer->slot[i].angle = buffer->memory + i * 3 * count;
+		buffer->slot[i].angvel = buffer->slot[i].angle + count;
+		buffer->slot[i].last_angle = buffer->slot[i].angvel + count;
+	}
+	atomic_init(&buffer->middle, 1);
+	buffer->back = 0;
+	buffer->front = 2;
+	return true;
+}
+
+void snapshot_free(struct snapshot_buffer *buffer) { FREE(buffer->memory); }
+
+struct snapshot *snapshot_back(struct snapshot_buffer *buffer) { return &buffer->slot[buffer->back]; }
+
+void snapshot_capture(struct snapshot *snapshot, const struct pendulum_system *system) {
+	memcpy(snapshot->angle, system->angle, system->count * sizeof(*snapshot->angle));
+	memcpy(snapshot->angvel, system->angvel, system->count * sizeof(*snapshot->angvel));
+}
+
+void snapshot_publish(struct snapshot_buffer *buffer) {
+	// release the writes to the back slot to the reader, and acquire the reader's writes to the slot it last gave up
+	buffer->back = atomic_exchange_explicit(&buffer->middle, buffer->back | SNAPSHOT_FRESH, memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+}
+
+const struct snapshot *snapshot_latest(struct snapshot_buffer *buffer) {
+	if (atomic_load_explicit(&buffer->middle, memory_order_relaxed) & SNAPSHOT_FRESH)
+		buffer->front = atomic_exchange_explicit(&buffer->middle, buffer->front, memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+	return &buffer->slot[buffer->front];
+}
@@ -0,0 +1,38 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "sim.h"
+
+// hands the latest state of the simulation to another thread without either side waiting, through a triple buffer
+// the writer fills the back slot and swaps it with the middle one, the reader swaps the middle slot for its front one if a newer
+// state was published since, so the reader always gets the newest complete state and intermediate states are dropped
+
+struct snapshot {
+	double time; // simulated seconds
+	double ke, gpe;
+	unsigned long ticks;
+	uint64_t due;       // CLOCK_MONOTONIC nanoseconds the last tick was due at, to interpolate from
+	uint64_t step_time; // nanoseconds spent stepping and computing the energy
+	bool lagging;       // ticks were dropped in the last second
+	double *angle, *angvel; // of each pendulum
+	double *last_angle;     // before the last tick
+};
+
+struct snapshot_buffer {
+	unsigned count;
+	struct snapshot slot[3];
+	double *memory;
+	_Alignas(64) _Atomic unsigned middle; // with SNAPSHOT_FRESH set when the reader hasn't taken it yet
+	_Alignas(64) unsigned back;           // owned by the writer
+	_Alignas(64) unsigned front;          // owned by the reader
+};
+
+bool snapshot_init(struct snapshot_buffer *buffer, unsigned count);
+void snapshot_free(struct snapshot_buffer *buffer);
+struct snapshot *snapshot_back(struct snapshot_buffer *buffer); // the slot for the writer to fill
+void snapshot_capture(struct snapshot *snapshot, const struct pendulum_system *system); // copies the angles and angular velocities
+void snapshot_publish(struct snapshot_buffer *buffer);
+const struct snapshot *snapshot_latest(struct snapshot_buffer *buffer); // stays valid until the next call
+#endif
@@ -0,0 +1,162 @@
+#include "sweep.h"
+#include "ensemble.h"
+#include "util.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#define CHUNK_BLOCKS 4 // ensemble blocks per unit of work, small enough to balance and large enough to keep stealing rare
+#define CHUNK (CHUNK_BLOCKS * VM_LANES)
+
+static const int var_per_pendulum = 2;
+
+// each worker owns a range of chunks, packed as (tail << 32 | head) so both ends move with one compare-and-swap
+// the owner takes chunks from the head, idle workers steal the back half from the tail
+struct worker {
+	_Alignas(64) _Atomic uint64_t range;
+	pthread_t thread;
+	struct sweep *sweep;
+	struct worker *workers;
+	unsigned index, count;
+	bool ok;
+};
+
+#define RANGE(head, tail) ((uint64_t) (tail) << 32 | (head))
+#define HEAD(range) ((uint32_t) (range))
+#define TAIL(range) ((uint32_t) ((range) >> 32))
+
+static bool pop(struct worker *worker, unsigned *chunk) {
+	uint64_t range = atomic_load(&worker->range);
+	do {
+		if (HEAD(range) >= TAIL(range)) return false;
+	} while (!atomic_compare_exchange_weak(&worker->range, &range, RANGE(HEAD(range) + 1, TAIL(range))));
+	*chunk = HEAD(range);
+	return true;
+}
+
+static bool steal(struct worker *thief) {
+	for (unsigned i = 1; i < thief->count; ++i) {
+		struct worker *victim = &thief->workers[(thief->index + i) % thief->count];
+		uint64_t range = atomic_load(&victim->range);
+		uint32_t head, tail, mid;
+		do {
+			head = HEAD(range), tail = TAIL(range);
+			if (head >= tail) break;
+			mid = tail - (tail - head + 1) / 2;
+		} while (!atomic_compare_exchange_weak(&victim->range, &range, RANGE(head, mid)));
+		if (head >= tail) continue;
+
+		// nobody steals from an empty range, so this can't race with another thief
+		atomic_store(&thief->range, RANGE(mid, tail));
+		return true;
+	}
+	return false;
+}
+
+// puts the grid point of each trajectory of the chunk into the ensemble
+static void load_chunk(struct sweep *sweep, struct sim_ensemble *ensemble, unsigned chunk) {
+	struct pendulum_system *system = sweep->system;
+	unsigned total = sweep->width * sweep->height, last = system->count - 1;
+	for (unsigned k = 0; k < CHUNK; ++k) {
+		unsigned i = chunk * CHUNK + k;
+		if (i >= total) i = total - 1; // pad the last chunk with copies
+		for (unsigned j = 0; j < system->count; ++j) {
+			*ensemble_angle(ensemble, k, j) = system->angle[j];
+			*ensemble_angvel(ensemble, k, j) = system->angvel[j];
+		}
+		*ensemble_angle(ensemble, k, 0) = M_PI * (2.0 * (i % sweep->width) / sweep->width - 1);
+		*ensemble_angle(ensemble, k, last) = M_PI * (2.0 * (i / sweep->width) / sweep->height - 1);
+	}
+}
+
+static void store_chunk(struct sweep *sweep, struct sim_ensemble *ensemble, unsigned chunk) {
+	unsigned count = sweep->system->count, total = sweep->width * sweep->height;
+	for (unsigned k = 0; k < CHUNK && chunk * CHUNK + k < total; ++k) {
+		double *out = &sweep->result[(size_t) (chunk * CHUNK + k) * count * var_per_pendulum];
+		for (unsigned j = 0; j < count; ++j) {
+			out[j * var_per_pendulum] = *ensemble_angle(ensemble, k, j);
+			out[j * var_per_pendulum + 1] = *ensemble_angvel(ensemble, k, j);
+		}
+	}
+}
+
+static void *work(void *arg) {
+	struct worker *worker = arg;
+	struct sweep *sweep = worker->sweep;
+
+	struct sim_ensemble ensemble = {0};
+	if (!ensemble_init(&ensemble, sweep->system, CHUNK)) return NULL;
+
+	unsigned chunk;
+	while (pop(worker, &chunk) || (steal(worker) && pop(worker, &chunk))) {
+		load_chunk(sweep, &ensemble, chunk);
+		if (!sim_step_batch(&ensemble, sweep->steps, sweep->time_span)) goto fail;
+		store_chunk(sweep, &ensemble, chunk);
+	}
+
+	worker->ok = true;
+fail:
+	ensemble_free(&ensemble);
+	return NULL;
+}
+
+static double seconds(void) {
+	struct timespec tp;
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return tp.tv_sec + tp.tv_nsec * 1e-9;
+}
+
+bool sweep_run(struct sweep *sweep) {
+	// trajectories are indexed by unsigned, including the padding of the last chunk
+	if (sweep->height && sweep->width > (UINT_MAX - CHUNK) / sweep->height) return false;
+	unsigned total = sweep->width * sweep->height, chunks = (total + CHUNK - 1) / CHUNK;
+	if (total == 0 || sweep->system->count == 0) return false;
+
+	unsigned threads = sweep->threads;
+	if (!threads) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? cpus : 1;
+	}
+	if (threads > chunks) threads = chunks;
+
+	bool ok = false;
+	sweep->result = malloc((size_t) total * sweep->system->count * var_per_pendulum * sizeof(*sweep->result));
+	struct worker *workers = aligned_alloc(_Alignof(struct worker), threads * sizeof(*workers));
+	if (!sweep->result || !workers) goto fail;
+
+	// start with an even split, stealing evens out whatever imbalance is left
+	for (unsigned i = 0; i < threads; ++i) {
+		struct worker *w = &workers[i];
+		*w = (struct worker) {.sweep = sweep, .workers = workers, .index = i, .count = threads};
+		atomic_init(&w->range, RANGE((uint64_t) chunks * i / threads, (uint64_t) chunks * (i + 1) / threads));
+	}
+
+	double start = seconds();
+	unsigned started;
+	for (started = 0; started < threads; ++started)
+		if (pthread_create(&workers[started].thread, NULL, work, &workers[started])) break;
+	ok = started > 0;
+	for (unsigned i = 0; i < started; ++i) {
+		pthread_join(workers[i].thread, NULL);
+		ok = ok && workers[i].ok;
+	}
+	sweep->elapsed = seconds() - start;
+
+	// a worker that failed to start leaves its chunks behind, which the others steal unless they had already finished
+	for (unsigned i = 0; i < threads; ++i) {
+		uint64_t range = atomic_load(&workers[i].range);
+		if (HEAD(range) < TAIL(range)) ok = false;
+	}
+
+fail:
+	free(workers);
+	if (!ok) FREE(sweep->result);
+	return ok;
+}
+
+void sweep_free(struct sweep *sweep) { FREE(sweep->result); }
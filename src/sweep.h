@@ -0,0 +1,21 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+#include <stdbool.h>
+#include "sim.h"
+
+// runs a grid of initial conditions without a display, spread over a pool of threads
+struct sweep {
+	struct pendulum_system *system; // initialised, only read by the workers
+	// the grid varies the initial angle of the first pendulum across and the last pendulum down, both over [-π, π)
+	unsigned width, height;
+	unsigned threads; // 0 for one per online CPU
+	int steps;
+	double time_span;
+	double *result;  // final angle and angular velocity of each pendulum of each trajectory, row by row, allocated by sweep_run
+	double elapsed;  // seconds spent integrating
+};
+
+// fails if the grid is empty or has too many trajectories to index with unsigned
+bool sweep_run(struct sweep *sweep);
+void sweep_free(struct sweep *sweep);
+#endif
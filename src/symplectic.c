@@ -0,0 +1,112 @@
+#include "symplectic.h"
+#include "lu.h"
+#include <math.h>
+#include <string.h>
+
+// with H(x, p) = ½ pᵀ M(x)⁻¹ p + V(x), where p = ∂L/∂v = M(x) v, ∂H/∂p = v and ∂H/∂x = -∂L/∂x
+// each step of size h is
+//   p' = p + h/2 ∂L/∂x(x, M(x)⁻¹ p')               implicit in p'
+//   x″ = x + h/2 (M(x)⁻¹ p' + M(x″)⁻¹ p')           implicit in x″
+//   p″ = p' + h/2 ∂L/∂x(x″, M(x″)⁻¹ p')
+// which is symplectic and time reversible, so the energy error stays bounded instead of drifting
+// the implicit equations are solved by fixed point iteration, which converges quickly at the step sizes used, and the step
+// fails if it doesn't converge within MAX_ITERATIONS rather than carrying on from an unconverged iterate
+
+#define MAX_ITERATIONS 50
+#define TOLERANCE 1e-12
+
+// loads the inputs shared by every tape
+static void load_inputs(struct pendulum_system *system, double *regs, const double *angle, const double *angvel) {
+	unsigned n = system->count;
+	double *state = sim_load_params(system, regs);
+	memcpy(state, angle, n * sizeof(*state));
+	if (angvel) memcpy(state + n, angvel, n * sizeof(*state));
+	else memset(state + n, 0, n * sizeof(*state));
+}
+
+static void mass_matrix(struct pendulum_system *system, const double *angle, double *mass) {
+	const struct tape *tape = &system->tape_mass;
+	load_inputs(system, system->regs_mass, angle, NULL);
+	tape_run(tape, system->regs_mass);
+	for (unsigned i = 0; i < tape->outputs; ++i) mass[i] = system->regs_mass[tape->output[i]];
+	++system->mass_evaluations;
+}
+
+static void force(struct pendulum_system *system, const double *angle, const double *angvel, double *out) {
+	const struct tape *tape = &system->tape_force;
+	load_inputs(system, system->regs_force, angle, angvel);
+	tape_run(tape, system->regs_force);
+	for (unsigned i = 0; i < tape->outputs; ++i) out[i] = system->regs_force[tape->output[i]];
+	++system->force_evaluations;
+}
+
+// true once next is within the tolerance of current, copying it over either way
+static bool converged(unsigned n, double *current, const double *next) {
+	double diff = 0, size = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		diff = fmax(diff, fabs(next[i] - current[i]));
+		size = fmax(size, fabs(next[i]));
+		current[i] = next[i];
+	}
+	return diff <= TOLERANCE * (1 + size);
+}
+
+bool symplectic_step(struct pendulum_system *system, int steps, double time_span, sim_sink *sink, void *data) {
+	if (!system->symplectic) return false;
+
+	unsigned n = system->count, *pivot = system->pivot;
+	double h = time_span / steps;
+	// the state arrays are stepped in place, angvel only holds the angular velocities again between steps
+	double *angle = system->angle, *angvel = system->angvel;
+	double *momentum = system->symplectic, *half = momentum + n, *angvel_start = half + n, *next = angvel_start + n,
+	       *angle_end = next + n, *mass = angle_end + n;
+
+	// convert the angular velocities to momenta
+	mass_matrix(system, angle, mass);
+	for (unsigned i = 0; i < n; ++i) {
+		momentum[i] = 0;
+		for (unsigned j = 0; j < n; ++j) momentum[i] += mass[i * n + j] * angvel[j];
+	}
+	if (!lu_factor(n, mass, pivot)) return false;
+
+	// the mass matrix is kept factorised at the current angles between steps
+	// and the force at the end of the previous step is kept in next, to predict the half step momentum from
+	for (int step = 0; step < steps; ++step) {
+		for (unsigned i = 0; i < n; ++i) half[i] = momentum[i] + (step ? h / 2 * next[i] : 0);
+		unsigned it;
+		for (it = 0; it < MAX_ITERATIONS; ++it) {
+			lu_solve(n, mass, pivot, half, angvel);
+			force(system, angle, angvel, next);
+			for (unsigned i = 0; i < n; ++i) next[i] = momentum[i] + h / 2 * next[i];
+			if (converged(n, half, next)) break;
+		}
+		if (it == MAX_ITERATIONS) return false;
+
+		lu_solve(n, mass, pivot, half, angvel_start);
+		for (unsigned i = 0; i < n; ++i) angle_end[i] = angle[i] + h * angvel_start[i];
+		for (it = 0; it < MAX_ITERATIONS; ++it) {
+			mass_matrix(system, angle_end, mass);
+			if (!lu_factor(n, mass, pivot)) return false;
+			lu_solve(n, mass, pivot, half, angvel);
+			for (unsigned i = 0; i < n; ++i) next[i] = angle[i] + h / 2 * (angvel_start[i] + angvel[i]);
+			if (converged(n, angle_end, next)) break;
+		}
+		if (it == MAX_ITERATIONS) return false;
+		memcpy(angle, angle_end, n * sizeof(*angle));
+		mass_matrix(system, angle, mass);
+		if (!lu_factor(n, mass, pivot)) return false;
+		lu_solve(n, mass, pivot, half, angvel);
+
+		force(system, angle, angvel, next);
+		for (unsigned i = 0; i < n; ++i) momentum[i] = half[i] + h / 2 * next[i];
+
+		if (sink) {
+			lu_solve(n, mass, pivot, momentum, angvel);
+			sink((step + 1) * h, angle, data);
+		}
+	}
+
+	// and back again
+	lu_solve(n, mass, pivot, momentum, angvel);
+	return true;
+}
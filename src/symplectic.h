@@ -0,0 +1,11 @@
+#ifndef SYMPLECTIC_H
+#define SYMPLECTIC_H
+#include "sim.h"
+
+// generalised leapfrog (Störmer–Verlet for a Hamiltonian that isn't separable) over the angles and their conjugate momenta
+// needs the mass matrix and generalised force tapes that sim_init derives from the Lagrangian for SIM_INTEGRATOR_SYMPLECTIC
+
+#define SYMPLECTIC_SCRATCH(count) ((count) * 5 + (count) * (count)) // doubles of scratch space needed by symplectic_step
+
+bool symplectic_step(struct pendulum_system *system, int steps, double time_span, sim_sink *sink, void *data);
+#endif
@@ -0,0 +1,398 @@
+#define _GNU_SOURCE // sincos
+#include "tape.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define ASSERT(x) \
+	if ((res = (x))) goto fail
+
+struct tape_builder {
+	struct tape *tape;
+	size_t code_size, constant_size;
+	CMapBasicBasic *regs; // maps each lowered expression to the register holding its value
+	basic one;
+};
+
+static bool emit(struct tape_builder *b, unsigned op, unsigned a, unsigned b_, unsigned *out) {
+	struct tape *tape = b->tape;
+	if (tape->length >= b->code_size) {
+		size_t size = b->code_size ? b->code_size * 2 : 64;
+		struct tape_instr *code = realloc(tape->code, size * sizeof(*code));
+		if (!code) return false;
+		tape->code = code;
+		b->code_size = size;
+	}
+	*out = tape->registers++;
+	tape->code[tape->length++] = (struct tape_instr) {.op = op, .out = *out, .a = a, .b = b_};
+	return true;
+}
+
+static bool emit_const(struct tape_builder *b, double value, unsigned *out) {
+	struct tape *tape = b->tape;
+	if (tape->constants >= b->constant_size) {
+		size_t size = b->constant_size ? b->constant_size * 2 : 16;
+		struct tape_const *constant = realloc(tape->constant, size * sizeof(*constant));
+		if (!constant) return false;
+		tape->constant = constant;
+		b->constant_size = size;
+	}
+	*out = tape->registers++;
+	tape->constant[tape->constants++] = (struct tape_const) {.reg = *out, .value = value};
+	return true;
+}
+
+static bool number_value(const basic expr, double *value) {
+	if (!is_a_Number(expr)) return false;
+	basic num;
+	basic_new_stack(num);
+	bool ret = !basic_evalf(num, expr, 53, 1);
+	if (ret) *value = real_double_get_d(num);
+	basic_free_stack(num);
+	return ret;
+}
+
+static bool get_arg(const basic expr, size_t index, basic out) {
+	CVecBasic *args = vecbasic_new();
+	if (!args) return false;
+	bool ret = !basic_get_args(expr, args) && index < vecbasic_size(args) && !vecbasic_get(args, index, out);
+	vecbasic_free(args);
+	return ret;
+}
+
+// whether a term of a sum has a negative numeric coefficient, e.g. -x or -2*x*y
+static bool is_negative(const basic expr) {
+	double value;
+	if (number_value(expr, &value)) return value < 0;
+	if (basic_get_type(expr) != SYMENGINE_MUL) return false;
+
+	basic coef;
+	basic_new_stack(coef);
+	bool ret = get_arg(expr, 0, coef) && number_value(coef, &value) && value < 0; // the coefficient is always the first argument
+	basic_free_stack(coef);
+	return ret;
+}
+
+// whether a factor of a product is a power with a negative numeric exponent, e.g. 1/x or x^-2
+static bool is_reciprocal(const basic expr) {
+	if (basic_get_type(expr) != SYMENGINE_POW) return false;
+
+	double value;
+	basic exp;
+	basic_new_stack(exp);
+	bool ret = get_arg(expr, 1, exp) && number_value(exp, &value) && value < 0;
+	basic_free_stack(exp);
+	return ret;
+}
+
+static bool lower(struct tape_builder *b, const basic expr, unsigned *out);
+
+// looks up or lowers sin(arg) or cos(arg)
+static bool lower_trig_of(struct tape_builder *b, const basic arg, bool sin, unsigned *out) {
+	basic expr;
+	basic_new_stack(expr);
+	bool ret = !(sin ? basic_sin(expr, arg) : basic_cos(expr, arg)) && lower(b, expr, out);
+	basic_free_stack(expr);
+	return ret;
+}
+
+// lowers sin(arg) or cos(arg), expanding sums so that the sines and cosines of differences between angles, which the solutions
+// are full of, are built from the sine and cosine of each angle instead of needing their own
+static bool lower_trig(struct tape_builder *b, const basic arg, bool sin, unsigned *out) {
+	bool ret = false;
+	CWRAPPER_OUTPUT_TYPE res = 0;
+	basic head, rest, reg;
+	basic_new_stack(head);
+	basic_new_stack(rest);
+	basic_new_stack(reg);
+
+	if (is_negative(arg)) {
+		// sin(-x) = -sin(x), cos(-x) = cos(x)
+		unsigned x;
+		ASSERT(basic_neg(head, arg));
+		if (!lower_trig_of(b, head, sin, &x)) goto fail;
+		if (!sin) *out = x;
+		else if (!emit(b, TAPE_NEG, x, 0, out)) goto fail;
+	} else if (basic_get_type(arg) == SYMENGINE_ADD) {
+		// sin(x + y) = sin x cos y + cos x sin y, cos(x + y) = cos x cos y - sin x sin y
+		if (!get_arg(arg, 0, head)) goto fail;
+		ASSERT(basic_sub(rest, arg, head));
+		unsigned sin_x, cos_x, sin_y, cos_y, p, q;
+		if (!lower_trig_of(b, head, true, &sin_x) || !lower_trig_of(b, head, false, &cos_x) ||
+		    !lower_trig_of(b, rest, true, &sin_y) || !lower_trig_of(b, rest, false, &cos_y))
+			goto fail;
+		if (sin) {
+			if (!emit(b, TAPE_MUL, sin_x, cos_y, &p) || !emit(b, TAPE_MUL, cos_x, sin_y, &q) || !emit(b, TAPE_ADD, p, q, out))
+				goto fail;
+		} else {
+			if (!emit(b, TAPE_MUL, cos_x, cos_y, &p) || !emit(b, TAPE_MUL, sin_x, sin_y, &q) || !emit(b, TAPE_SUB, p, q, out))
+				goto fail;
+		}
+	} else {
+		// the sine and cosine come from one instruction, so register both for whichever is lowered next
+		unsigned x;
+		if (!lower(b, arg, &x) || !emit(b, TAPE_SINCOS, x, 0, out)) goto fail;
+		++b->tape->registers;
+		ASSERT(basic_sin(head, arg));
+		ASSERT(integer_set_ui(reg, *out));
+		mapbasicbasic_insert(b->regs, head, reg);
+		ASSERT(basic_cos(head, arg));
+		ASSERT(integer_set_ui(reg, *out + 1));
+		mapbasicbasic_insert(b->regs, head, reg);
+		if (!sin) ++*out;
+	}
+
+	ret = true;
+fail:
+	if (res) fprintf(stderr, "SymEngine exception %d\n", res);
+	basic_free_stack(head);
+	basic_free_stack(rest);
+	basic_free_stack(reg);
+	return ret;
+}
+
+static bool lower_powi(struct tape_builder *b, unsigned base, unsigned exp, unsigned *out) {
+	if (exp == 1) {
+		*out = base;
+		return true;
+	}
+	unsigned half;
+	if (!lower_powi(b, base, exp / 2, &half)) return false;
+	if (exp % 2 == 0) return emit(b, TAPE_MUL, half, half, out);
+	unsigned square;
+	return emit(b, TAPE_MUL, half, half, &square) && emit(b, TAPE_MUL, square, base, out);
+}
+
+// lowers a sum or product, turning negated terms into subtraction and reciprocal factors into division
+static bool lower_assoc(struct tape_builder *b, const basic expr, bool sum, unsigned *out) {
+	bool ret = false;
+	CWRAPPER_OUTPUT_TYPE res = 0;
+	CVecBasic *args = vecbasic_new();
+	basic arg, inv;
+	basic_new_stack(arg);
+	basic_new_stack(inv);
+	if (!args) goto fail;
+	ASSERT(basic_get_args(expr, args));
+
+	bool negate = false, first = true;
+	unsigned acc = 0;
+	for (size_t i = 0; i < vecbasic_size(args); ++i) {
+		ASSERT(vecbasic_get(args, i, arg));
+
+		double value;
+		if (!sum && i == 0 && number_value(arg, &value) && value == -1) {
+			negate = true; // -x*y is stored as Mul(-1, x, y)
+			continue;
+		}
+
+		bool inverse = sum ? is_negative(arg) : is_reciprocal(arg);
+		if (inverse && sum) {
+			ASSERT(basic_neg(inv, arg));
+		} else if (inverse) {
+			ASSERT(basic_div(inv, b->one, arg));
+		}
+
+		unsigned reg;
+		if (!lower(b, inverse ? inv : arg, &reg)) goto fail;
+
+		if (first) {
+			first = false;
+			if (!inverse) acc = reg;
+			else if (sum) {
+				if (!emit(b, TAPE_NEG, reg, 0, &acc)) goto fail;
+			} else {
+				unsigned one;
+				if (!lower(b, b->one, &one)) goto fail;
+				if (!emit(b, TAPE_DIV, one, reg, &acc)) goto fail;
+			}
+		} else {
+			unsigned op = sum ? (inverse ? TAPE_SUB : TAPE_ADD) : (inverse ? TAPE_DIV : TAPE_MUL);
+			if (!emit(b, op, acc, reg, &acc)) goto fail;
+		}
+	}
+
+	if (first) goto fail; // SymEngine never produces empty sums or products
+	if (negate && !emit(b, TAPE_NEG, acc, 0, &acc)) goto fail;
+
+	*out = acc;
+	ret = true;
+fail:
+	if (res) fprintf(stderr, "SymEngine exception %d\n", res);
+	vecbasic_free(args);
+	basic_free_stack(arg);
+	basic_free_stack(inv);
+	return ret;
+}
+
+static bool lower(struct tape_builder *b, const basic expr, unsigned *out) {
+	bool ret = false;
+	CWRAPPER_OUTPUT_TYPE res = 0;
+	basic reg, arg, exp;
+	basic_new_stack(reg);
+	basic_new_stack(arg);
+	basic_new_stack(exp);
+
+	// reuse the register of an identical subexpression
+	if (mapbasicbasic_get(b->regs, expr, reg)) {
+		*out = integer_get_ui(reg);
+		ret = true;
+		goto fail;
+	}
+
+	double value;
+	if (number_value(expr, &value)) {
+		if (!emit_const(b, value, out)) goto fail;
+	} else {
+		switch (basic_get_type(expr)) {
+			case SYMENGINE_ADD:
+				if (!lower_assoc(b, expr, true, out)) goto fail;
+				break;
+			case SYMENGINE_MUL:
+				if (!lower_assoc(b, expr, false, out)) goto fail;
+				break;
+			case SYMENGINE_POW: {
+				if (!get_arg(expr, 0, arg) || !get_arg(expr, 1, exp)) goto fail;
+				unsigned base, power;
+				if (number_value(exp, &value) && value < 0) {
+					// x^-n = 1/x^n
+					unsigned one;
+					ASSERT(basic_div(arg, b->one, expr));
+					if (!lower(b, b->one, &one) || !lower(b, arg, &power)) goto fail;
+					if (!emit(b, TAPE_DIV, one, power, out)) goto fail;
+				} else if (number_value(exp, &value) && value == floor(value) && value >= 1 && value <= 16) {
+					// small integer powers are cheaper as repeated multiplication
+					if (!lower(b, arg, &base)) goto fail;
+					if (!lower_powi(b, base, value, out)) goto fail;
+				} else {
+					if (!lower(b, arg, &base) || !lower(b, exp, &power)) goto fail;
+					if (!emit(b, TAPE_POW, base, power, out)) goto fail;
+				}
+				break;
+			}
+			case SYMENGINE_SIN:
+			case SYMENGINE_COS:
+				if (!get_arg(expr, 0, arg) || !lower_trig(b, arg, basic_get_type(expr) == SYMENGINE_SIN, out)) goto fail;
+				break;
+			default: {
+				char *str = basic_str(expr);
+				fprintf(stderr, "Cannot compile expression: %s\n", str ? str : "?");
+				basic_str_free(str);
+				goto fail;
+			}
+		}
+	}
+
+	ASSERT(integer_set_ui(reg, *out));
+	mapbasicbasic_insert(b->regs, expr, reg);
+	ret = true;
+fail:
+	if (res) fprintf(stderr, "SymEngine exception %d\n", res);
+	basic_free_stack(reg);
+	basic_free_stack(arg);
+	basic_free_stack(exp);
+	return ret;
+}
+
+bool tape_compile(struct tape *tape, CVecBasic *inputs, CVecBasic *outputs) {
+	bool ret = false;
+	CWRAPPER_OUTPUT_TYPE res = 0;
+
+	*tape = (struct tape) {0};
+	struct tape_builder b = {.tape = tape, .regs = mapbasicbasic_new()};
+	basic expr, reg;
+	basic_new_stack(b.one);
+	basic_new_stack(expr);
+	basic_new_stack(reg);
+	if (!b.regs) goto fail;
+	basic_const_one(b.one);
+
+	// input symbols occupy the first registers
+	tape->inputs = tape->registers = vecbasic_size(inputs);
+	for (unsigned i = 0; i < tape->inputs; ++i) {
+		ASSERT(vecbasic_get(inputs, i, expr));
+		ASSERT(integer_set_ui(reg, i));
+		mapbasicbasic_insert(b.regs, expr, reg);
+	}
+
+	tape->outputs = vecbasic_size(outputs);
+	tape->output = calloc(tape->outputs, sizeof(*tape->output));
+	if (!tape->output) goto fail;
+	for (unsigned i = 0; i < tape->outputs; ++i) {
+		ASSERT(vecbasic_get(outputs, i, expr));
+		if (!lower(&b, expr, &tape->output[i])) goto fail;
+	}
+
+	ret = true;
+fail:
+	if (res) fprintf(stderr, "SymEngine exception %d\n", res);
+	mapbasicbasic_free(b.regs);
+	basic_free_stack(b.one);
+	basic_free_stack(expr);
+	basic_free_stack(reg);
+	if (!ret) tape_free(tape);
+	return ret;
+}
+
+void tape_free(struct tape *tape) {
+	free(tape->code);
+	free(tape->constant);
+	free(tape->output);
+	*tape = (struct tape) {0};
+}
+
+double *tape_regs_new(const struct tape *tape, unsigned lanes) {
+	double *regs = calloc((tape->registers ? tape->registers : 1) * lanes, sizeof(*regs));
+	if (!regs) return NULL;
+	for (unsigned i = 0; i < tape->constants; ++i)
+		for (unsigned l = 0; l < lanes; ++l) regs[tape->constant[i].reg * lanes + l] = tape->constant[i].value;
+	return regs;
+}
+
+void tape_run(const struct tape *tape, double *regs) {
+	const struct tape_instr *i = tape->code, *end = i + tape->length;
+	for (; i < end; ++i) {
+		switch (i->op) {
+			case TAPE_ADD: regs[i->out] = regs[i->a] + regs[i->b]; break;
+			case TAPE_SUB: regs[i->out] = regs[i->a] - regs[i->b]; break;
+			case TAPE_MUL: regs[i->out] = regs[i->a] * regs[i->b]; break;
+			case TAPE_DIV: regs[i->out] = regs[i->a] / regs[i->b]; break;
+			case TAPE_NEG: regs[i->out] = -regs[i->a]; break;
+			case TAPE_POW: regs[i->out] = pow(regs[i->a], regs[i->b]); break;
+			case TAPE_SINCOS: sincos(regs[i->a], &regs[i->out], &regs[i->out + 1]); break;
+		}
+	}
+}
+
+VM_TARGET_CLONES
+void tape_run_batch(const struct tape *tape, double *regs) {
+	const struct tape_instr *i = tape->code, *end = i + tape->length;
+	for (; i < end; ++i) {
+		// instructions never read their own output register
+		double *restrict out = regs + i->out * VM_LANES;
+		const double *restrict a = regs + i->a * VM_LANES, *restrict b = regs + i->b * VM_LANES;
+		switch (i->op) {
+			case TAPE_ADD:
+				for (unsigned l = 0; l < VM_LANES; ++l) out[l] = a[l] + b[l];
+				break;
+			case TAPE_SUB:
+				for (unsigned l = 0; l < VM_LANES; ++l) out[l] = a[l] - b[l];
+				break;
+			case TAPE_MUL:
+				for (unsigned l = 0; l < VM_LANES; ++l) out[l] = a[l] * b[l];
+				break;
+			case TAPE_DIV:
+				for (unsigned l = 0; l < VM_LANES; ++l) out[l] = a[l] / b[l];
+				break;
+			case TAPE_NEG:
+				for (unsigned l = 0; l < VM_LANES; ++l) out[l] = -a[l];
+				break;
+			case TAPE_POW:
+				for (unsigned l = 0; l < VM_LANES; ++l) out[l] = pow(a[l], b[l]);
+				break;
+			case TAPE_SINCOS:
+				for (unsigned l = 0; l < VM_LANES; ++l) vm_sincos(a[l], &out[l], &out[VM_LANES + l]);
+				break;
+		}
+	}
+}
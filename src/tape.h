@@ -0,0 +1,42 @@
+#ifndef TAPE_H
+#define TAPE_H
+#include <symengine/cwrapper.h>
+#include <stdbool.h>
+#include "vmath.h"
+
+enum tape_op {
+	TAPE_ADD,
+	TAPE_SUB,
+	TAPE_MUL,
+	TAPE_DIV,
+	TAPE_NEG,
+	TAPE_POW,
+	TAPE_SINCOS, // writes the sine to out and the cosine to out + 1
+};
+
+struct tape_instr {
+	unsigned op, out, a, b;
+};
+
+struct tape_const {
+	unsigned reg;
+	double value;
+};
+
+// numeric program lowered from SymEngine expressions, evaluated over a flat register file
+// registers [0, inputs) hold the input symbols in the order given to tape_compile, the rest are constants and intermediate results
+// sines and cosines of sums are expanded with the angle addition identities, so each distinct argument that is left only needs one
+// TAPE_SINCOS per evaluation, however many outputs use it
+struct tape {
+	unsigned inputs, registers, length, constants, outputs;
+	struct tape_instr *code;
+	struct tape_const *constant;
+	unsigned *output; // register holding each output
+};
+
+bool tape_compile(struct tape *tape, CVecBasic *inputs, CVecBasic *outputs);
+void tape_free(struct tape *tape);
+double *tape_regs_new(const struct tape *tape, unsigned lanes); // allocate a register file laid out as [register][lane], with the constants loaded
+void tape_run(const struct tape *tape, double *regs);
+void tape_run_batch(const struct tape *tape, double *regs); // evaluate VM_LANES sets of inputs at once
+#endif
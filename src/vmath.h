@@ -0,0 +1,43 @@
+#ifndef VMATH_H
+#define VMATH_H
+// helpers for evaluating many trajectories at once, in loops over VM_LANES that the compiler can vectorise
+
+#define VM_LANES 8 // trajectories evaluated together, one AVX-512 register of doubles
+
+// build vectorised functions for each instruction set and pick one at load time, since ./build doesn't pass -march
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define VM_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define VM_TARGET_CLONES
+#endif
+
+// branch-free sin and cos (Cephes polynomials) so calls inside lane loops can be vectorised, unlike libm
+// accurate to about 1 ulp for |x| < 2^30
+static inline void vm_sincos(double x, double *sin_out, double *cos_out) {
+	// reduce to z in [-π/4, π/4], where x = z + q π/2, with π/2 split into three parts to keep precision
+	int q = (int) (x * 0.63661977236758134308 + (x < 0 ? -0.5 : 0.5));
+	double qd = q;
+	double z = ((x - qd * 1.57079625129699707031e+00) - qd * 7.54978941586159635336e-08) - qd * 5.39030285815811905290e-15;
+	double zz = z * z;
+
+	double s = z + z * zz * (((((1.58962301576546568060e-10 * zz - 2.50507477628578072866e-8) * zz + 2.75573136213857245213e-6) * zz - 1.98412698295895385996e-4) * zz + 8.33333333332211858878e-3) * zz - 1.66666666666666307295e-1);
+	double c = 1 - 0.5 * zz + zz * zz * (((((-1.13585365213876817300e-11 * zz + 2.08757008419747316778e-9) * zz - 2.75573141792967388112e-7) * zz + 2.48015872888517045348e-5) * zz - 1.38888888888730564116e-3) * zz + 4.16666666666665929218e-2);
+
+	// rotate by the quadrant
+	double rs = q & 1 ? c : s, rc = q & 1 ? s : c;
+	*sin_out = q & 2 ? -rs : rs;
+	*cos_out = (q + 1) & 2 ? -rc : rc;
+}
+
+static inline double vm_sin(double x) {
+	double s, c;
+	vm_sincos(x, &s, &c);
+	return s;
+}
+
+static inline double vm_cos(double x) {
+	double s, c;
+	vm_sincos(x, &s, &c);
+	return c;
+}
+#endif